@@ -1,6 +1,10 @@
 import { decodeAudioDataAny } from "$lib/utils/utils.js";
 import ZiggyProcessor from "./worklets/ZiggyProcessor.js?url"
 
+// Decoded tables kept for re-sending; the engine keeps its own copy of each
+// table it has, so this only saves refetching and decoding recently used ones
+const AUDIO_CACHE_ENTRIES = 32;
+
 export default class Ziggy {
     constructor(properties, { audioContext }) {
         this.audioContext = audioContext;
@@ -25,6 +29,9 @@ export default class Ziggy {
             "semi2":0,
             "cent2":7,
             "osc2Enabled":1,
+            "interp1":0,
+            "interp2":0,
+            "interp3":0,
             "mix":0.5,
             "fmAmount":0,
             "filterType":0,
@@ -45,6 +52,21 @@ export default class Ziggy {
             "lfoAmount":0,
             "lfoFadeIn":0,
             "lfoDestination":0,
+            "lfo2Waveform":4,
+            "lfo2Retrigger":0,
+            "lfo2Rate":0.3,
+            "mod1Source":0,
+            "mod1Destination":0,
+            "mod1Depth":0,
+            "mod2Source":0,
+            "mod2Destination":0,
+            "mod2Depth":0,
+            "mod3Source":0,
+            "mod3Destination":0,
+            "mod3Depth":0,
+            "mod4Source":0,
+            "mod4Destination":0,
+            "mod4Depth":0,
             "portamento":0,
             "autoPanWidth":0,
             "autoPanRate":0.5,
@@ -109,9 +131,17 @@ export default class Ziggy {
     //     });
     // }
 
+    // Decoded here and sent as float samples ('loadwavetable'), the message
+    // the shipped worklet bundle handles. The engine can decode the files
+    // itself ('loadencodedwavetable'), but worklets/ZiggyProcessor.js has to
+    // be rebuilt with build.sh before Ziggy can send them that way.
     async preloadAudio(url) {
         if (this.audioCache.has(url)) {
-            return this.audioCache.get(url);
+            // Map order is the LRU order
+            const wavetable = this.audioCache.get(url);
+            this.audioCache.delete(url);
+            this.audioCache.set(url, wavetable);
+            return wavetable;
         }
 
         const response = await fetch(url);
@@ -142,6 +172,9 @@ export default class Ziggy {
         }
 
         this.audioCache.set(url, wavetable);
+        if (this.audioCache.size > AUDIO_CACHE_ENTRIES) {
+            this.audioCache.delete(this.audioCache.keys().next().value);
+        }
         return wavetable;
     }
 
@@ -152,7 +185,6 @@ export default class Ziggy {
         
         const wavetableCopy = new Float32Array(wavetable);
         
-        
         this.synthNode.port.postMessage({
             type: 'loadwavetable',
             key: url,
@@ -160,12 +192,14 @@ export default class Ziggy {
         }, [wavetableCopy.buffer]);
     }
 
-    noteon(note, velocity = 1) {
-        this.synthNode.port.postMessage({ type: 'noteon', key: note, v: velocity });
+    // time is an optional AudioContext time; the engine applies the event on
+    // that exact sample, or as soon as possible when omitted
+    noteon(note, velocity = 1, time) {
+        this.synthNode.port.postMessage({ type: 'noteon', key: note, v: velocity, time });
     }
 
-    noteoff(note) {
-        this.synthNode.port.postMessage({ type: 'noteoff', key: note });
+    noteoff(note, time) {
+        this.synthNode.port.postMessage({ type: 'noteoff', key: note, time });
     }
 
     abortAllNotes() {
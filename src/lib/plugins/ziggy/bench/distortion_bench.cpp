@@ -0,0 +1,112 @@
+// Cost and aliasing of each distortion shape and quality mode.
+//
+// Drives a 5 kHz sine at 44.1 kHz through the stage and measures everything
+// in the spectrum that isn't a harmonic of it (aliases folded back from
+// above Nyquist), relative to the fundamental. Cost is the render time per
+// base-rate sample for one voice.
+//
+//   ziggy-distortion-bench [--amount A]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "distortion.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kBlock = 128;
+constexpr int kFftSize = 4096;
+// 465 cycles in kFftSize samples: about 5006 Hz, and the output repeats
+// exactly every kFftSize samples so no window is needed
+constexpr int kToneBin = 465;
+
+double binPower(const std::vector<float>& x, int bin) {
+    double re = 0.0, im = 0.0;
+    for (int n = 0; n < kFftSize; ++n) {
+        double phase = 2.0 * M_PI * bin * n / kFftSize;
+        re += x[n] * std::cos(phase);
+        im -= x[n] * std::sin(phase);
+    }
+    return re * re + im * im;
+}
+
+// Non-harmonic power over the fundamental, in dB
+double aliasLevel(Distortion::Shape shape, Distortion::Quality quality, float amount) {
+    Distortion distortion(kBlock);
+    std::vector<float> capture;
+    std::vector<float> block(kBlock);
+    const int warmup = 16;
+    const int blocks = warmup + kFftSize / kBlock;
+    for (int b = 0; b < blocks; ++b) {
+        for (int i = 0; i < kBlock; ++i) {
+            int n = b * kBlock + i;
+            block[i] = 0.5f * static_cast<float>(std::sin(2.0 * M_PI * kToneBin * n / kFftSize));
+        }
+        distortion.process(block.data(), kBlock, amount, shape, quality);
+        if (b >= warmup) capture.insert(capture.end(), block.begin(), block.end());
+    }
+
+    double fundamental = binPower(capture, kToneBin);
+    double alias = 0.0;
+    for (int bin = 1; bin < kFftSize / 2; ++bin) {
+        if (bin % kToneBin == 0) continue;
+        alias += binPower(capture, bin);
+    }
+    return 10.0 * std::log10(alias / fundamental);
+}
+
+double nsPerSample(Distortion::Shape shape, Distortion::Quality quality, float amount) {
+    // Saw at ~220 Hz
+    std::vector<float> saw(kBlock * 64);
+    for (size_t i = 0; i < saw.size(); ++i) saw[i] = 2.0f * std::fmod(i * 0.005f, 1.0f) - 1.0f;
+
+    Distortion distortion(kBlock);
+    std::vector<float> block(kBlock);
+    const int blocks = 20000;
+    volatile float sink = 0.0f;
+    auto start = Clock::now();
+    for (int b = 0; b < blocks; ++b) {
+        std::memcpy(block.data(), &saw[(b % 64) * kBlock], kBlock * sizeof(float));
+        distortion.process(block.data(), kBlock, amount, shape, quality);
+        sink = sink + block[0];
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    return ns / (static_cast<double>(blocks) * kBlock);
+}
+
+}
+
+int main(int argc, char** argv) {
+    float amount = 0.7f;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--amount") == 0 && i + 1 < argc) {
+            amount = static_cast<float>(std::atof(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: ziggy-distortion-bench [--amount A]\n");
+            return 1;
+        }
+    }
+
+    const char* shapes[] = {"hard clip", "tanh", "wavefolder"};
+    const char* qualities[] = {"plain", "adaa", "2x", "4x"};
+    // Cost includes copying the input in; amount 0 is the bypass, i.e. that
+    // overhead alone
+    std::printf("amount %.2f, 5 kHz tone at 44.1 kHz\n", amount);
+    std::printf("%-11s %-6s %12s %14s\n", "shape", "mode", "ns/sample", "aliases (dBc)");
+    std::printf("%-11s %-6s %12.2f %14s\n", "-", "bypass",
+                nsPerSample(Distortion::Shape::HardClip, Distortion::Quality::Plain, 0.0f), "-");
+    for (int s = 0; s < 3; ++s) {
+        for (int q = 0; q < 4; ++q) {
+            auto shape = static_cast<Distortion::Shape>(s);
+            auto quality = static_cast<Distortion::Quality>(q);
+            std::printf("%-11s %-6s %12.2f %14.1f\n", shapes[s], qualities[q],
+                        nsPerSample(shape, quality, amount), aliasLevel(shape, quality, amount));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Accuracy and speed of fast_math.h against libm.
+//
+// Sweeps each approximation (scalar and 4-lane; pow is 4-lane only) over
+// the ranges the synth uses, reports the worst absolute and relative error
+// against double precision libm, and the cost per call. Exits 1 if any
+// function is outside the bound documented in fast_math.h, or, in optimized
+// builds without sanitizers, if either version is not faster than libm (the
+// 4-lane one only with SSE or wasm SIMD).
+//
+//   ziggy-fastmath-bench
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+#include <vector>
+#include "fast_math.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Range {
+    float lo, hi;
+    bool logSpaced;
+};
+
+struct Errors {
+    double maxAbs = 0.0;
+    double maxRel = 0.0;
+};
+
+constexpr int kPoints = 1 << 20;
+
+std::vector<float> sweep(const Range& r) {
+    const double lo = r.lo, hi = r.hi;
+    std::vector<float> xs(kPoints);
+    for (int i = 0; i < kPoints; ++i) {
+        double t = static_cast<double>(i) / (kPoints - 1);
+        xs[i] = static_cast<float>(r.logSpaced ? lo * std::pow(hi / lo, t) : lo + (hi - lo) * t);
+    }
+    return xs;
+}
+
+void accumulate(Errors& e, double expected, double got) {
+    double abs = std::fabs(got - expected);
+    e.maxAbs = std::max(e.maxAbs, abs);
+    if (std::fabs(expected) > 1e-30) e.maxRel = std::max(e.maxRel, abs / std::fabs(expected));
+}
+
+// Timings are the fastest of kTimingRuns sweeps, taking turns between libm
+// and the approximations, so a busy machine doesn't fail the speed check
+constexpr int kTimingRuns = 5;
+
+// Sanitizer builds time their instrumentation rather than the code
+#if defined(NDEBUG) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+constexpr bool kCheckSpeed = true;
+#else
+constexpr bool kCheckSpeed = false;
+#endif
+
+// The scalar simd.h fallback runs lanes one at a time; nothing to gain there
+#if ZIGGY_SIMD_SCALAR
+constexpr bool kCheckLaneSpeed = false;
+#else
+constexpr bool kCheckLaneSpeed = true;
+#endif
+
+template <typename F>
+double nsPerCall(const std::vector<float>& xs, F&& f) {
+    volatile float sink = 0.0f;
+    float acc = 0.0f;
+    auto start = Clock::now();
+    for (float x : xs) acc += f(x);
+    sink = sink + acc;
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / xs.size();
+}
+
+template <typename F>
+double nsPerCallSimd(const std::vector<float>& xs, F&& f) {
+    volatile float sink = 0.0f;
+    simd::f32x4 acc = simd::set1(0.0f);
+    auto start = Clock::now();
+    for (size_t i = 0; i + 4 <= xs.size(); i += 4) acc = simd::add(acc, f(simd::load(&xs[i])));
+    sink = sink + simd::lane3(acc);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / xs.size();
+}
+
+// absBound / relBound of 0 skip that check. fast is nullptr for functions
+// with only a 4-lane version.
+template <typename Ref, typename Fast, typename FastSimd, typename Libm>
+bool check(const char* name, Range range, Ref reference, Fast fast, FastSimd fastSimd, Libm libm,
+           double absBound, double relBound) {
+    constexpr bool hasScalar = !std::is_same<Fast, std::nullptr_t>::value;
+    const std::vector<float> xs = sweep(range);
+    Errors scalar, lanes;
+    alignas(16) float out[4];
+    for (size_t i = 0; i + 4 <= xs.size(); i += 4) {
+        simd::store(out, fastSimd(simd::load(&xs[i])));
+        for (int k = 0; k < 4; ++k) {
+            double expected = reference(static_cast<double>(xs[i + k]));
+            if constexpr (hasScalar) accumulate(scalar, expected, fast(xs[i + k]));
+            accumulate(lanes, expected, out[k]);
+        }
+    }
+
+    double libmNs = 0.0, fastNs = 0.0, simdNs = 0.0;
+    for (int run = 0; run < kTimingRuns; ++run) {
+        double ns = nsPerCall(xs, libm);
+        if (run == 0 || ns < libmNs) libmNs = ns;
+        if constexpr (hasScalar) {
+            ns = nsPerCall(xs, fast);
+            if (run == 0 || ns < fastNs) fastNs = ns;
+        }
+        ns = nsPerCallSimd(xs, fastSimd);
+        if (run == 0 || ns < simdNs) simdNs = ns;
+    }
+
+    bool accurate = true;
+    for (const Errors* e : {&scalar, &lanes}) {
+        if (absBound > 0.0 && e->maxAbs > absBound) accurate = false;
+        if (relBound > 0.0 && e->maxRel > relBound) accurate = false;
+    }
+    const bool faster = (!hasScalar || fastNs < libmNs) && (!kCheckLaneSpeed || simdNs < libmNs);
+    // Scalar columns read "-" without a scalar version
+    char scalarAbs[16] = "   -    ", scalarRel[16] = "   -    ", scalarNs[16] = "   -";
+    if (hasScalar) {
+        std::snprintf(scalarAbs, sizeof(scalarAbs), "%.2e", scalar.maxAbs);
+        std::snprintf(scalarRel, sizeof(scalarRel), "%.2e", scalar.maxRel);
+        std::snprintf(scalarNs, sizeof(scalarNs), "%5.2f", fastNs);
+    }
+    std::printf("%-5s [%9g, %9g]  abs %s / %.2e  rel %s / %.2e  ns: libm %5.2f fast %s x4 %5.2f  %s\n",
+                name, range.lo, range.hi, scalarAbs, lanes.maxAbs, scalarRel, lanes.maxRel,
+                libmNs, scalarNs, simdNs,
+                !accurate ? "OUT OF BOUND" : !faster ? (kCheckSpeed ? "SLOWER THAN LIBM" : "ok (unoptimized)") : "ok");
+    return accurate && (faster || !kCheckSpeed);
+}
+
+}
+
+int main() {
+    using simd::f32x4;
+    auto exp2Ref = [](double x) { return std::exp2(x); };
+    auto exp2Fast = [](float x) { return fastmath::exp2(x); };
+    auto exp2Simd = [](f32x4 x) { return fastmath::exp2(x); };
+    auto exp2Libm = [](float x) { return std::exp2(x); };
+    auto sinRef = [](double x) { return std::sin(x); };
+    auto sinFast = [](float x) { return fastmath::sin(x); };
+    auto sinSimd = [](f32x4 x) { return fastmath::sin(x); };
+    auto sinLibm = [](float x) { return std::sin(x); };
+    auto cosRef = [](double x) { return std::cos(x); };
+    auto cosFast = [](float x) { return fastmath::cos(x); };
+    auto cosSimd = [](f32x4 x) { return fastmath::cos(x); };
+    auto cosLibm = [](float x) { return std::cos(x); };
+
+    auto log2Fast = [](float x) { return fastmath::log2(x); };
+    auto log2Lanes = [](f32x4 x) { return fastmath::log2(x); };
+    auto glideLanes = [](f32x4 x) { return fastmath::pow(x, simd::set1(0.37f)); };
+
+    bool ok = true;
+    std::printf("worst error scalar / 4-lane against double libm\n");
+
+    // Full range, pitch ratios (+-10 octaves) and envelope decays
+    ok &= check("exp2", {-126.0f, 126.0f, false}, exp2Ref, exp2Fast, exp2Simd, exp2Libm, 0.0, 2.5e-7);
+    ok &= check("exp2", {-10.0f, 10.0f, false}, exp2Ref, exp2Fast, exp2Simd, exp2Libm, 0.0, 2.5e-7);
+    ok &= check("exp", {-20.0f, 0.0f, false}, [](double x) { return std::exp(x); },
+                [](float x) { return fastmath::exp(x); }, [](f32x4 x) { return fastmath::exp(x); },
+                [](float x) { return std::exp(x); }, 0.0, 2.5e-7 + 20.0 * 6e-8);
+
+    ok &= check("log2", {1e-30f, 1e30f, true}, [](double x) { return std::log2(x); },
+                log2Fast, log2Lanes, [](float x) { return std::log2(x); }, 2.5e-7 + 100.0 * 6e-8, 0.0);
+    // Portamento: ratio between two notes up to 64x apart
+    ok &= check("pow", {1.0f / 64.0f, 64.0f, true}, [](double x) { return std::pow(x, 0.37); },
+                nullptr, glideLanes, [](float x) { return std::pow(x, 0.37f); }, 0.0, 5e-7);
+
+    // Filter w0 and the LFO / pan phase, then the full supported range
+    ok &= check("sin", {0.0f, 3.14159265f, false}, sinRef, sinFast, sinSimd, sinLibm, 2.5e-7, 0.0);
+    ok &= check("cos", {0.0f, 3.14159265f, false}, cosRef, cosFast, cosSimd, cosLibm, 2.5e-7, 0.0);
+    ok &= check("sin", {-8192.0f, 8192.0f, false}, sinRef, sinFast, sinSimd, sinLibm, 2.5e-7, 0.0);
+    ok &= check("cos", {-8192.0f, 8192.0f, false}, cosRef, cosFast, cosSimd, cosLibm, 2.5e-7, 0.0);
+
+    // Distortion drive reaches about +-9
+    ok &= check("tanh", {-20.0f, 20.0f, false}, [](double x) { return std::tanh(x); },
+                [](float x) { return fastmath::tanh(x); }, [](f32x4 x) { return fastmath::tanh(x); },
+                [](float x) { return std::tanh(x); }, 2.5e-7, 5e-7);
+
+    return ok ? 0 : 1;
+}
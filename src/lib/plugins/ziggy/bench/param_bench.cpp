@@ -0,0 +1,95 @@
+// Microbenchmark: cost of the per-block parameter reads in Synth::processBuffer,
+// processFilter and processLFO, comparing the old string-keyed std::map lookups
+// with the flat SynthParams table, plus a full voice-block for scale.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "synth.h"
+#include "params.h"
+#include "wavetable_arena.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kBlockSize = 128;
+constexpr int kIterations = 200000;
+
+// Parameters read once per voice-block by the render path
+const Param kBlockParams[] = {
+    Param::FmAmount, Param::Mix, Param::Cutoff, Param::FilterKeyTracking,
+    Param::LfoDestination, Param::FilterEnvAmount, Param::Osc2Enabled,
+    Param::Wave3Level, Param::Osc3Enabled, Param::Distortion,
+    Param::Resonance, Param::FilterType,
+    Param::LfoRate, Param::LfoSync, Param::LfoWaveform, Param::LfoFadeIn, Param::LfoAmount,
+};
+
+double nsPerIteration(Clock::time_point start, int iterations) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    return static_cast<double>(elapsed.count()) / iterations;
+}
+
+}
+
+int main() {
+    volatile float sink = 0.0f;
+
+    // Before: std::map<std::string, float> keyed by property name
+    std::map<std::string, float> legacy;
+    for (size_t i = 0; i < kNumParams; ++i) {
+        legacy[paramName(static_cast<Param>(i))] = SynthParams()[static_cast<Param>(i)];
+    }
+    std::vector<std::string> keys;
+    for (Param p : kBlockParams) keys.push_back(paramName(p));
+
+    auto start = Clock::now();
+    for (int it = 0; it < kIterations; ++it) {
+        float acc = 0.0f;
+        for (const auto& key : keys) acc += legacy[key];
+        sink = sink + acc;
+    }
+    double mapNs = nsPerIteration(start, kIterations);
+
+    // After: flat SynthParams indexed by Param
+    SynthParams params;
+    start = Clock::now();
+    for (int it = 0; it < kIterations; ++it) {
+        float acc = 0.0f;
+        for (Param p : kBlockParams) acc += params[p];
+        sink = sink + acc;
+    }
+    double tableNs = nsPerIteration(start, kIterations);
+
+    // Full voice-block for scale
+    const int sineLength = 1348;
+    WavetableArena arena(Wavetable::storageFor(sineLength) * sizeof(float) + WavetableArena::kAlignment);
+    TableHandle sine = arena.allocate(sineLength);
+    float* samples = arena.samples(sine);
+    for (int i = 0; i < sineLength; ++i) {
+        samples[i] = std::sin(6.28318530718f * i / sineLength);
+    }
+    arena.finalize(sine);
+    Synth voice(44100.0f);
+    voice.setWavetable1(arena.get(sine));
+    voice.setWavetable2(arena.get(sine));
+    voice.noteOn(60, 1.0f);
+
+    float buffer[kBlockSize];
+    start = Clock::now();
+    for (int it = 0; it < kIterations; ++it) {
+        for (float& s : buffer) s = 0.0f;
+        voice.processBuffer(buffer, kBlockSize);
+        sink = sink + buffer[0];
+    }
+    double voiceNs = nsPerIteration(start, kIterations);
+
+    std::printf("parameter reads per voice-block: %zu\n", keys.size());
+    std::printf("  std::map lookups : %8.1f ns/voice-block\n", mapNs);
+    std::printf("  SynthParams table: %8.1f ns/voice-block\n", tableNs);
+    std::printf("full voice-block   : %8.1f ns/voice-block\n", voiceNs);
+    return 0;
+}
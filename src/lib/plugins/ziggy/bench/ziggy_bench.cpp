@@ -0,0 +1,884 @@
+// Offline render benchmark for PolySynth.
+//
+// Renders a scripted MIDI performance (dense chords, voice-stealing bursts and
+// per-block parameter sweeps), fed through the engine's timestamped event
+// queue, into memory and reports ns per sample per voice,
+// peak voice count and realtime factor.
+//
+//   ziggy-bench [--seconds N] [--voices N] [--polyphony N] [--block N] [--rate HZ]
+//               [--threads N] [--planar] [--blocks-per-call N] [--sweep-blocks]
+//               [--random-midi] [--unison N] [--wave FILE] [--wave-format F]
+//               [--routes N] [--sweep-routes] [--interp Q] [--sweep-interp]
+//               [--check-cache] [--check-interp] [--check-pitch] [--write-wave FILE]
+//
+// With --threads N > 1 the render is repeated serially and the two outputs are
+// compared bit for bit. --planar renders into separate channel buffers and
+// --blocks-per-call N hands the engine N planar blocks per call; the output
+// hash is over the same sample order for every layout, so runs can be
+// compared. --unison N stacks N detuned copies of oscillator 1 in every
+// voice; voice counts and ns per sample per voice stay per voice. --wave FILE
+// plays an Ogg/Vorbis or WAV file on oscillator 1 instead of the built-in
+// saw, decoded by the engine's background loader as the worklet does it.
+// --wave-format int16|half stores that table compactly; the run is then
+// repeated with a float table and the output's SNR against it reported,
+// with both tables' memory and throughput. --routes N adds N modulation
+// matrix routes to the patch, and --sweep-routes renders with 0 to
+// ModMatrix::kSlots of them to table what each costs. --interp
+// linear|hermite|sinc reads oscillators 1 and 2 at that interpolation tier,
+// and --sweep-interp renders with each to table what they cost.
+// --check-cache (with --wave) plays the file from two keys in turn with a
+// wavetable cache big enough for one, so each note evicts the other key's
+// table, and fails if a note doesn't sound once its table is reloaded.
+// --check-interp fails if a one-shot table's first samples at the Hermite or
+// sinc tier stray from linear's, i.e. if taps before its start read anything
+// but silence. --check-pitch plays one sine note at 44.1, 48 and 96 kHz and
+// fails unless each measures the same frequency. --write-wave FILE writes a
+// 16-bit WAV wavetable for --wave, so the checks need no sample files.
+//
+// --random-midi plays a long randomized stream instead (random host block
+// sizes up to --block and output layouts, notes from both the control side
+// and the event queue, patch and polyphony changes) and fails if the engine
+// allocated on the audio path; with --wave the file is also reloaded in the
+// background every so often, swapping tables under sounding voices, and
+// played from a second key with a wavetable cache only big enough for one,
+// so tables are decoded on first use and evicted all along. That
+// check needs a build with the allocation
+// audit, i.e. a Debug build or -DZIGGY_ALLOC_AUDIT=ON. --sweep-blocks renders the same performance at host
+// block sizes from 32 to 1024 frames and tables the latency each adds against
+// throughput and the slowest block's share of its deadline.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "alloc_audit.h"
+#include "audio_decoder.h"
+#include "polysynth.h"
+#include "wavetable.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+    float seconds = 10.0f;
+    int voices = 16;
+    int polyphony = 16;
+    int blockSize = 128;
+    float sampleRate = 44100.0f;
+    int threads = 1;
+    bool sweepBlocks = false;
+    bool randomMidi = false;
+    bool planar = false;
+    int blocksPerCall = 1;
+    int unison = 1;
+    const char* wave = nullptr;
+    std::vector<uint8_t> waveBytes;  // the file behind --wave
+    SampleFormat waveFormat = SampleFormat::Float32;
+    bool keepOutput = false;  // keep the rendered samples in RenderStats
+    int routes = 0;
+    bool sweepRoutes = false;
+    Interpolation interpolation = Interpolation::Linear;
+    bool sweepInterp = false;
+    bool checkCache = false;
+    bool checkInterp = false;
+    bool checkPitch = false;
+    const char* writeWave = nullptr;
+};
+
+// Matrix slots --routes turns on, in order
+struct BenchRoute {
+    ModSource source;
+    ModDestination destination;
+    float depth;
+};
+const BenchRoute kBenchRoutes[ModMatrix::kSlots] = {
+    {ModSource::Lfo2, ModDestination::Pitch, 0.01f},
+    {ModSource::AmpEnvelope, ModDestination::Mix, -0.3f},
+    {ModSource::Velocity, ModDestination::Fm, 0.5f},
+    {ModSource::Lfo2, ModDestination::Phase, 0.05f},
+};
+
+// Parameter sweeps land every kSweepFrames regardless of the host block size,
+// so every block size renders the same work
+constexpr int kSweepFrames = 128;
+constexpr int kMaxBenchBlock = 4096;
+
+struct ScriptEvent {
+    enum Type { NoteOn, NoteOff } type;
+    int64_t frame;
+    int note;
+};
+
+struct RenderStats {
+    double elapsedNs = 0.0;
+    double worstBlockNs = 0.0;
+    int64_t frames = 0;
+    int64_t voiceSamples = 0;
+    int peakVoices = 0;
+    float checksum = 0.0f;
+    uint64_t outputHash = 1469598103934665603ull;  // FNV-1a over the output bits
+    int64_t notesQueued = 0;
+    size_t tableBytes = 0;      // wavetable arena in use
+    std::vector<float> output;  // interleaved, with keepOutput
+    EngineCounters counters;
+};
+
+// Deterministic LCG so every run renders the same performance
+uint32_t nextRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+std::vector<ScriptEvent> buildScript(const BenchConfig& config) {
+    std::vector<ScriptEvent> events;
+    const int64_t totalFrames = static_cast<int64_t>(config.seconds * config.sampleRate);
+    const int64_t chordStep = static_cast<int64_t>(0.5f * config.sampleRate);
+    const int64_t chordLength = static_cast<int64_t>(0.45f * config.sampleRate);
+    const int64_t burstStep = static_cast<int64_t>(2.0f * config.sampleRate);
+    const int roots[] = {48, 53, 55, 50, 57, 52};
+    const int shape[] = {0, 4, 7, 11, 14, 19};
+    uint32_t rng = 12345;
+
+    // Dense six-note chords, overlapping their release tails
+    int chordIndex = 0;
+    for (int64_t frame = 0; frame < totalFrames; frame += chordStep, ++chordIndex) {
+        int root = roots[chordIndex % 6];
+        for (int interval : shape) {
+            events.push_back({ScriptEvent::NoteOn, frame, root + interval});
+            events.push_back({ScriptEvent::NoteOff, frame + chordLength, root + interval});
+        }
+    }
+
+    // Bursts of 32 notes to force voice stealing, like a sequencer's chord
+    // bursts: every other one lands on a single frame, the rest within 10 ms
+    int burstIndex = 0;
+    for (int64_t frame = burstStep / 2; frame < totalFrames; frame += burstStep, ++burstIndex) {
+        for (int i = 0; i < 32; ++i) {
+            int note = 36 + static_cast<int>(nextRandom(rng) % 60);
+            int64_t spread = nextRandom(rng) % 441;
+            int64_t at = frame + (burstIndex % 2 ? 0 : spread);
+            events.push_back({ScriptEvent::NoteOn, at, note});
+            events.push_back({ScriptEvent::NoteOff, at + chordLength / 2, note});
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const ScriptEvent& a, const ScriptEvent& b) {
+        return a.frame < b.frame;
+    });
+    return events;
+}
+
+void loadPatch(PolySynth& synth, const BenchConfig& config) {
+    if (config.wave) {
+        // Key 1: the --wave file, decoded in the background
+        synth.loadEncodedWavetable(1, config.waveBytes, config.waveFormat);
+        // Decoded before the first note, so renders are repeatable
+        synth.preloadWavetable(1);
+        synth.waitForWavetables();
+    } else if (config.waveFormat != SampleFormat::Float32) {
+        // Compact tables are converted from float samples
+        std::vector<float> saw(1348);
+        for (size_t i = 0; i < saw.size(); ++i) saw[i] = 2.0f * i / saw.size() - 1.0f;
+        synth.loadWavetable(1, saw, config.waveFormat);
+    } else {
+        // Key 1: band-rich saw, the heaviest case for the oscillator and
+        // filter. Written in place through the zero-copy path the worklet uses
+        const int sawLength = 1348;
+        float* saw = synth.beginWavetable(sawLength);
+        for (int i = 0; i < sawLength; ++i) {
+            saw[i] = 2.0f * i / sawLength - 1.0f;
+        }
+        synth.commitWavetable(1);
+    }
+
+    synth.setProperty(Param::Polyphony, static_cast<float>(config.polyphony));
+    synth.setProperty(Param::Wave1, 1);
+    synth.setProperty(Param::Wave2, 0);
+    synth.setProperty(Param::Osc2Enabled, 1);
+    synth.setProperty(Param::FmAmount, 0.3f);
+    synth.setProperty(Param::FilterType, 0);  // Lowpass 24
+    synth.setProperty(Param::Resonance, 0.7f);
+    synth.setProperty(Param::AmpAttack, 0.01f);
+    synth.setProperty(Param::AmpRelease, 0.3f);
+    synth.setProperty(Param::LfoAmount, 0.2f);
+    synth.setProperty(Param::LfoDestination, 1);  // Filter
+    synth.setProperty(Param::AutoPanWidth, 0.8f);
+    synth.setProperty(Param::MasterGain, 0.3f);
+    synth.setProperty(Param::Unison, static_cast<float>(config.unison));
+    synth.setProperty(Param::UnisonDetune, 0.3f);
+    synth.setProperty(Param::Interp1, static_cast<float>(config.interpolation));
+    synth.setProperty(Param::Interp2, static_cast<float>(config.interpolation));
+    for (int r = 0; r < config.routes; ++r) {
+        const int first = static_cast<int>(Param::Mod1Source) + r * 3;
+        synth.setProperty(static_cast<Param>(first), static_cast<float>(kBenchRoutes[r].source) + 1);
+        synth.setProperty(static_cast<Param>(first + 1), static_cast<float>(kBenchRoutes[r].destination));
+        synth.setProperty(static_cast<Param>(first + 2), kBenchRoutes[r].depth);
+    }
+}
+
+RenderStats render(const BenchConfig& config) {
+    PolySynth synth(config.sampleRate, config.voices, config.blockSize);
+    synth.setRenderThreads(config.threads);
+    loadPatch(synth, config);
+
+    const std::vector<ScriptEvent> script = buildScript(config);
+    const int64_t totalFrames = static_cast<int64_t>(config.seconds * config.sampleRate);
+    // Frames per engine call; interleaved output, or left then right
+    const int callFrames = config.blockSize * config.blocksPerCall;
+    std::vector<float> output(static_cast<size_t>(callFrames) * 2);
+    const uintptr_t outputPtr = reinterpret_cast<uintptr_t>(output.data());
+    const uintptr_t rightPtr = reinterpret_cast<uintptr_t>(output.data() + callFrames);
+
+    RenderStats stats;
+    stats.tableBytes = synth.wavetableArena().bytesUsed();
+    if (config.keepOutput) stats.output.reserve(static_cast<size_t>(totalFrames + callFrames) * 2);
+    size_t nextEvent = 0;
+    auto start = Clock::now();
+
+    for (int64_t frame = 0; frame < totalFrames; frame += callFrames) {
+        // Queue everything due in this call with its exact frame; the
+        // engine splits blocks at each timestamp. The queue is consumed in
+        // order, so notes and parameter sweeps go in merged by frame.
+        const int64_t callEnd = frame + callFrames;
+        auto queueNotesBefore = [&](int64_t end) {
+            while (nextEvent < script.size() && script[nextEvent].frame < end) {
+                const ScriptEvent& e = script[nextEvent++];
+                EngineEvent event = {e.type == ScriptEvent::NoteOn ? EngineEvent::NoteOn : EngineEvent::NoteOff,
+                                     static_cast<uint32_t>(e.frame), e.note, 0.8f};
+                synth.events().push(event);
+                if (e.type == ScriptEvent::NoteOn) stats.notesQueued++;
+            }
+        };
+        int64_t firstSweep = (frame + kSweepFrames - 1) / kSweepFrames * kSweepFrames;
+        for (int64_t at = firstSweep; at < callEnd; at += kSweepFrames) {
+            queueNotesBefore(at);
+            // Fast parameter sweeps
+            float t = static_cast<float>(at) / config.sampleRate;
+            uint32_t sweepFrame = static_cast<uint32_t>(at);
+            synth.events().push({EngineEvent::SetParam, sweepFrame, static_cast<int32_t>(Param::Cutoff),
+                                 0.5f + 0.4f * std::sin(2.0f * 3.14159265f * 2.0f * t)});
+            synth.events().push({EngineEvent::SetParam, sweepFrame, static_cast<int32_t>(Param::FmAmount),
+                                 0.3f + 0.2f * std::sin(2.0f * 3.14159265f * 0.7f * t)});
+        }
+        queueNotesBefore(callEnd);
+
+        int active = synth.activeVoiceCount();
+        stats.peakVoices = std::max(stats.peakVoices, active);
+        stats.voiceSamples += static_cast<int64_t>(active) * callFrames;
+
+        auto callBegin = Clock::now();
+        if (config.blocksPerCall > 1) {
+            synth.processBlocks(outputPtr, rightPtr, config.blockSize, config.blocksPerCall);
+        } else if (config.planar) {
+            synth.processPlanar(outputPtr, rightPtr, config.blockSize);
+        } else {
+            synth.processBuffer(outputPtr, config.blockSize);
+        }
+        double callNs = std::chrono::duration<double, std::nano>(Clock::now() - callBegin).count();
+        stats.worstBlockNs = std::max(stats.worstBlockNs, callNs / config.blocksPerCall);
+        stats.frames += callFrames;
+
+        // Hash in interleaved order whatever the layout
+        const bool interleaved = !config.planar && config.blocksPerCall == 1;
+        for (int i = 0; i < callFrames; ++i) {
+            float pair[2] = {interleaved ? output[i * 2] : output[i],
+                             interleaved ? output[i * 2 + 1] : output[callFrames + i]};
+            if (i % config.blockSize == 0) stats.checksum += pair[0];
+            if (config.keepOutput) stats.output.insert(stats.output.end(), pair, pair + 2);
+            for (float sample : pair) {
+                uint32_t bits;
+                std::memcpy(&bits, &sample, sizeof(bits));
+                stats.outputHash = (stats.outputHash ^ bits) * 1099511628211ull;
+            }
+        }
+    }
+
+    stats.elapsedNs = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    stats.counters = synth.counters();
+    return stats;
+}
+
+bool parseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!std::strcmp(arg, "--sweep-blocks")) {
+            config.sweepBlocks = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--random-midi")) {
+            config.randomMidi = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--planar")) {
+            config.planar = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--sweep-routes")) {
+            config.sweepRoutes = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--sweep-interp")) {
+            config.sweepInterp = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--check-cache")) {
+            config.checkCache = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--check-interp")) {
+            config.checkInterp = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--check-pitch")) {
+            config.checkPitch = true;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) {
+            std::fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        if (!std::strcmp(arg, "--seconds")) config.seconds = std::strtof(value, nullptr);
+        else if (!std::strcmp(arg, "--voices")) config.voices = std::atoi(value);
+        else if (!std::strcmp(arg, "--polyphony")) config.polyphony = std::atoi(value);
+        else if (!std::strcmp(arg, "--block")) config.blockSize = std::atoi(value);
+        else if (!std::strcmp(arg, "--rate")) config.sampleRate = std::strtof(value, nullptr);
+        else if (!std::strcmp(arg, "--threads")) config.threads = std::atoi(value);
+        else if (!std::strcmp(arg, "--blocks-per-call")) config.blocksPerCall = std::atoi(value);
+        else if (!std::strcmp(arg, "--unison")) config.unison = std::atoi(value);
+        else if (!std::strcmp(arg, "--wave")) config.wave = value;
+        else if (!std::strcmp(arg, "--routes")) config.routes = std::atoi(value);
+        else if (!std::strcmp(arg, "--write-wave")) config.writeWave = value;
+        else if (!std::strcmp(arg, "--interp")) {
+            if (!std::strcmp(value, "hermite")) config.interpolation = Interpolation::Hermite;
+            else if (!std::strcmp(value, "sinc")) config.interpolation = Interpolation::Sinc;
+            else if (std::strcmp(value, "linear")) {
+                std::fprintf(stderr, "--interp must be linear, hermite or sinc\n");
+                return false;
+            }
+        }
+        else if (!std::strcmp(arg, "--wave-format")) {
+            if (!std::strcmp(value, "int16")) config.waveFormat = SampleFormat::Int16;
+            else if (!std::strcmp(value, "half")) config.waveFormat = SampleFormat::Half;
+            else if (std::strcmp(value, "float")) {
+                std::fprintf(stderr, "--wave-format must be float, int16 or half\n");
+                return false;
+            }
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+        ++i;
+    }
+    if (config.blockSize < 1 || config.blockSize > kMaxBenchBlock) {
+        std::fprintf(stderr, "--block must be between 1 and %d\n", kMaxBenchBlock);
+        return false;
+    }
+    return config.seconds > 0.0f && config.voices > 0 && config.sampleRate > 0.0f && config.threads > 0 &&
+           config.blocksPerCall > 0 && config.unison >= 1 && config.unison <= kMaxUnison &&
+           config.routes >= 0 && config.routes <= ModMatrix::kSlots;
+}
+
+struct RandomParam {
+    Param id;
+    float low, high;
+    bool integer;
+};
+
+// Patch changes for the random stream. Wave key 2 is never loaded, unless
+// with --wave.
+const RandomParam kRandomParams[] = {
+    {Param::FilterType, 0, 3, true},         {Param::Cutoff, 0, 1, false},
+    {Param::Resonance, 0, 1, false},         {Param::Distortion, 0, 1, false},
+    {Param::DistortionCharacter, 0, 1, false}, {Param::DistortionQuality, 0, 3, true},
+    {Param::FmAmount, 0, 1, false},          {Param::Osc2Enabled, 0, 1, true},
+    {Param::Osc3Enabled, 0, 1, true},        {Param::NoiseLevel, 0, 1, false},
+    {Param::Wave1, 0, 2, true},              {Param::Wave2, 0, 2, true},
+    {Param::Interp1, 0, 2, true},            {Param::Interp2, 0, 2, true},
+    {Param::Interp3, 0, 2, true},
+    {Param::LfoAmount, 0, 1, false},         {Param::LfoDestination, 0, 4, true},
+    {Param::Portamento, 0, 0.5f, false},     {Param::AmpAttack, 0, 0.2f, false},
+    {Param::AmpRelease, 0.01f, 1, false},    {Param::Unison, 1, 8, true},
+    {Param::UnisonDetune, 0, 1, false},      {Param::Lfo2Rate, 0, 1, false},
+    {Param::Lfo2Retrigger, 0, 1, true},      {Param::Mod1Source, 0, kModSources, true},
+    {Param::Mod1Destination, 0, kModDestinations - 1, true}, {Param::Mod1Depth, -1, 1, false},
+    {Param::Mod4Source, 0, kModSources, true}, {Param::Mod4Destination, 0, kModDestinations - 1, true},
+    {Param::Mod4Depth, -1, 1, false},
+};
+
+float randomUnit(uint32_t& state) {
+    return static_cast<float>(nextRandom(state) & 0xffff) / 65535.0f;
+}
+
+int randomMidi(const BenchConfig& config) {
+    PolySynth synth(config.sampleRate, config.voices, config.blockSize);
+    synth.setRenderThreads(config.threads);
+    loadPatch(synth, config);
+    if (config.wave) {
+        // Key 2 gets the file too, decoded on first use, and the cache only
+        // has room for one: keys 1 and 2 evict each other whenever idle
+        synth.loadEncodedWavetable(2, config.waveBytes, config.waveFormat);
+        synth.setWavetableBudget(synth.wavetableStats().bytes);
+    }
+
+    std::vector<float> left(static_cast<size_t>(config.blockSize) * 2);
+    std::vector<float> right(static_cast<size_t>(config.blockSize));
+    const uintptr_t leftPtr = reinterpret_cast<uintptr_t>(left.data());
+    const uintptr_t rightPtr = reinterpret_cast<uintptr_t>(right.data());
+    const int64_t totalFrames = static_cast<int64_t>(config.seconds * config.sampleRate);
+    const int paramCount = static_cast<int>(sizeof(kRandomParams) / sizeof(kRandomParams[0]));
+
+    uint32_t rng = 777;
+    int64_t notes = 0;
+    int peakVoices = 0;
+    int64_t blocks = 0;
+    int reloads = 0;
+    const uint64_t allocationsBefore = realtimeAllocationCount();
+    for (int64_t frame = 0; frame < totalFrames;) {
+        const int block = 1 + static_cast<int>(nextRandom(rng) % config.blockSize);
+        const uint32_t blockStart = synth.currentFrame();
+
+        // Queued events at increasing offsets in the block, plus the odd
+        // direct call from the control side
+        for (int offset = 0;; ) {
+            offset += static_cast<int>(nextRandom(rng) % (block / 2 + 1));
+            if (offset >= block || nextRandom(rng) % 4 == 0) break;
+            const uint32_t at = blockStart + offset;
+            const int note = 24 + static_cast<int>(nextRandom(rng) % 48);
+            switch (nextRandom(rng) % 8) {
+                case 0: case 1: case 2: {
+                    float velocity = nextRandom(rng) % 8 == 0 ? 0.0f : randomUnit(rng);
+                    synth.events().push({EngineEvent::NoteOn, at, note, velocity});
+                    ++notes;
+                    break;
+                }
+                case 3: case 4:
+                    synth.events().push({EngineEvent::NoteOff, at, note, 0.0f});
+                    break;
+                case 5: {
+                    const RandomParam& p = kRandomParams[nextRandom(rng) % paramCount];
+                    float value = p.low + (p.high - p.low) * randomUnit(rng);
+                    if (p.integer) value = std::round(value);
+                    synth.events().push({EngineEvent::SetParam, at, static_cast<int32_t>(p.id), value});
+                    break;
+                }
+                case 6:
+                    synth.events().push({EngineEvent::SetParam, at, static_cast<int32_t>(Param::Polyphony),
+                                         static_cast<float>(1 + nextRandom(rng) % config.voices)});
+                    break;
+                default:
+                    if (nextRandom(rng) % 2) {
+                        synth.noteOn(note, randomUnit(rng));
+                        ++notes;
+                    } else {
+                        synth.noteOff(note);
+                    }
+                    break;
+            }
+        }
+
+        switch (nextRandom(rng) % 3) {
+            case 0: synth.processBuffer(leftPtr, block); break;
+            case 1: synth.processPlanar(leftPtr, rightPtr, block); break;
+            default:
+                if (block % 2 == 0) synth.processBlocks(leftPtr, rightPtr, block / 2, 2);
+                else synth.processPlanar(leftPtr, rightPtr, block);
+                break;
+        }
+        peakVoices = std::max(peakVoices, synth.activeVoiceCount());
+        frame += block;
+
+        // Republish the wave from the control side while voices play it
+        if (config.wave && ++blocks % 256 == 0) {
+            synth.loadEncodedWavetable(1, config.waveBytes, config.waveFormat);
+            ++reloads;
+        }
+    }
+    synth.waitForWavetables();
+    const uint64_t allocations = realtimeAllocationCount() - allocationsBefore;
+    const EngineCounters& c = synth.counters();
+    const bool allStarted = c.notes == static_cast<uint64_t>(notes);
+
+    std::printf("random stream     : %.1f s @ %.0f Hz, blocks of 1-%d, %d voices, %d thread(s)\n",
+                config.seconds, config.sampleRate, config.blockSize, config.voices, config.threads);
+    std::printf("notes started     : %llu of %lld, %llu stolen voices (peak %d voices)\n",
+                static_cast<unsigned long long>(c.notes), static_cast<long long>(notes),
+                static_cast<unsigned long long>(c.steals), peakVoices);
+    if (config.wave) {
+        const WavetableStats tables = synth.wavetableStats();
+        std::printf("wave reloads      : %d, %d failed\n", reloads, synth.failedWavetables());
+        std::printf("wave cache        : %llu hits, %llu misses, %llu loads, %llu evictions, %zu of %zu KB\n",
+                    static_cast<unsigned long long>(tables.hits), static_cast<unsigned long long>(tables.misses),
+                    static_cast<unsigned long long>(tables.loads), static_cast<unsigned long long>(tables.evictions),
+                    tables.bytes / 1024, tables.budget / 1024);
+    }
+    if (!kAllocAudit) {
+        std::printf("audio allocations : not checked, build with the allocation audit\n");
+        return allStarted ? 0 : 1;
+    }
+    std::printf("audio allocations : %llu\n", static_cast<unsigned long long>(allocations));
+    return allocations == 0 && allStarted ? 0 : 1;
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) return false;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) bytes.insert(bytes.end(), chunk, chunk + n);
+    std::fclose(file);
+    return true;
+}
+
+// One cycle of a band-limited saw as a mono 16-bit WAV, the table size
+// Ziggy.js resamples single cycles to
+bool writeWave(const char* path) {
+    const int frames = 1348;
+    std::vector<uint8_t> bytes;
+    auto put = [&bytes](uint32_t value, int size) {
+        for (int i = 0; i < size; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    };
+    const uint32_t dataBytes = frames * 2;
+    bytes.insert(bytes.end(), {'R', 'I', 'F', 'F'});
+    put(36 + dataBytes, 4);
+    bytes.insert(bytes.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put(16, 4);
+    put(1, 2);      // PCM
+    put(1, 2);      // mono
+    put(44100, 4);
+    put(44100 * 2, 4);
+    put(2, 2);
+    put(16, 2);
+    bytes.insert(bytes.end(), {'d', 'a', 't', 'a'});
+    put(dataBytes, 4);
+    for (int i = 0; i < frames; ++i) {
+        double s = 0.0;
+        for (int h = 1; h <= 32; ++h) s += std::sin(6.283185307179586 * h * i / frames) / h;
+        put(static_cast<uint16_t>(static_cast<int16_t>(std::lround(s * 0.5 * 32767.0))), 2);
+    }
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    const bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Reads --wave and checks the engine can decode it, timing the decode
+bool prepareWave(BenchConfig& config) {
+    if (!readFile(config.wave, config.waveBytes)) {
+        std::fprintf(stderr, "cannot read %s\n", config.wave);
+        return false;
+    }
+    std::vector<float> samples;
+    auto start = Clock::now();
+    bool decoded = decodeAudio(config.waveBytes.data(), config.waveBytes.size(), samples);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (!decoded) {
+        std::fprintf(stderr, "cannot decode %s (Ogg/Vorbis %s in this build)\n", config.wave,
+                     canDecodeVorbis() ? "is supported" : "needs libvorbisfile");
+        return false;
+    }
+    std::printf("wave              : %s, %zu samples from %zu bytes, decoded in %.2f ms\n", config.wave,
+                samples.size(), config.waveBytes.size(), ms);
+    return true;
+}
+
+// Compact table quality and cost: the same performance against float tables
+int compareFormats(const BenchConfig& config) {
+    BenchConfig compact = config;
+    compact.keepOutput = true;
+    BenchConfig reference = compact;
+    reference.waveFormat = SampleFormat::Float32;
+    RenderStats a = render(compact);
+    RenderStats b = render(reference);
+
+    double signal = 0.0, noise = 0.0;
+    for (size_t i = 0; i < b.output.size(); ++i) {
+        double error = static_cast<double>(a.output[i]) - b.output[i];
+        signal += static_cast<double>(b.output[i]) * b.output[i];
+        noise += error * error;
+    }
+    const char* name = config.waveFormat == SampleFormat::Int16 ? "int16" : "half";
+    std::printf("%.1f s @ %.0f Hz, block %d, %d voices (polyphony %d), %d thread(s)\n", config.seconds,
+                config.sampleRate, config.blockSize, config.voices, config.polyphony, config.threads);
+    std::printf("%8s %14s %16s\n", "tables", "arena KB", "ns/sample/voice");
+    for (const RenderStats* stats : {&a, &b}) {
+        double ns = stats->voiceSamples > 0 ? stats->elapsedNs / stats->voiceSamples : 0.0;
+        std::printf("%8s %14.1f %16.2f\n", stats == &a ? name : "float", stats->tableBytes / 1024.0, ns);
+    }
+    if (noise > 0.0) std::printf("SNR vs float      : %.1f dB\n", 10.0 * std::log10(signal / noise));
+    else std::printf("SNR vs float      : identical\n");
+    return 0;
+}
+
+// What each modulation route costs: the same performance with more routes
+int sweepRoutes(const BenchConfig& config) {
+    std::printf("%.1f s @ %.0f Hz, block %d, %d voices (polyphony %d), %d thread(s)\n", config.seconds,
+                config.sampleRate, config.blockSize, config.voices, config.polyphony, config.threads);
+    std::printf("%6s %16s %12s\n", "routes", "ns/sample/voice", "ns/block");
+    double baseline = 0.0;
+    for (int routes = 0; routes <= ModMatrix::kSlots; ++routes) {
+        BenchConfig run = config;
+        run.routes = routes;
+        // Best of three: the differences are small next to scheduling noise
+        double nsPerVoiceSample = 0.0;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            RenderStats stats = render(run);
+            double ns = stats.voiceSamples > 0 ? stats.elapsedNs / stats.voiceSamples : 0.0;
+            if (attempt == 0 || ns < nsPerVoiceSample) nsPerVoiceSample = ns;
+        }
+        if (routes == 0) baseline = nsPerVoiceSample;
+        // A voice block's control pass costs what its samples cost over the baseline
+        std::printf("%6d %16.2f %12.1f\n", routes, nsPerVoiceSample,
+                    (nsPerVoiceSample - baseline) * config.blockSize);
+    }
+    return 0;
+}
+
+// What each interpolation tier costs over linear, on oscillators 1 and 2
+int sweepInterp(const BenchConfig& config) {
+    static const char* const kNames[] = {"linear", "hermite", "sinc"};
+    std::printf("%.1f s @ %.0f Hz, block %d, %d voices (polyphony %d), unison %d, %d thread(s)\n", config.seconds,
+                config.sampleRate, config.blockSize, config.voices, config.polyphony, config.unison, config.threads);
+    std::printf("%8s %16s %10s\n", "tier", "ns/sample/voice", "vs linear");
+    double baseline = 0.0;
+    for (int tier = 0; tier <= static_cast<int>(Interpolation::Sinc); ++tier) {
+        BenchConfig run = config;
+        run.interpolation = static_cast<Interpolation>(tier);
+        // Best of three, as for the routes
+        double nsPerVoiceSample = 0.0;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            RenderStats stats = render(run);
+            double ns = stats.voiceSamples > 0 ? stats.elapsedNs / stats.voiceSamples : 0.0;
+            if (attempt == 0 || ns < nsPerVoiceSample) nsPerVoiceSample = ns;
+        }
+        if (tier == 0) baseline = nsPerVoiceSample;
+        std::printf("%8s %16.2f %9.2fx\n", kNames[tier], nsPerVoiceSample,
+                    baseline > 0.0 ? nsPerVoiceSample / baseline : 0.0);
+    }
+    return 0;
+}
+
+// Keys 1 and 2 evict each other: every note after the first misses, and
+// must sound once the worker has reloaded its table
+int checkCache(const BenchConfig& config) {
+    PolySynth synth(config.sampleRate, config.voices, config.blockSize);
+    loadPatch(synth, config);
+    synth.loadEncodedWavetable(2, config.waveBytes, config.waveFormat);
+    synth.setWavetableBudget(synth.wavetableStats().bytes);
+
+    std::vector<float> output(static_cast<size_t>(config.blockSize) * 2);
+    const uintptr_t outputPtr = reinterpret_cast<uintptr_t>(output.data());
+    // Ten seconds of audio, ample for a note to release and leave its table idle
+    const int releaseBlocks = static_cast<int>(10.0f * config.sampleRate / config.blockSize);
+    bool allSounded = true;
+    for (int note = 0; note < 6; ++note) {
+        const int key = note % 2 + 1;
+        synth.setProperty(Param::Wave1, static_cast<float>(key));
+        synth.noteOn(60, 1.0f);
+        bool sounded = false;
+        const auto start = Clock::now();
+        while (!sounded && Clock::now() - start < std::chrono::seconds(1)) {
+            synth.serviceWavetables();
+            synth.processBuffer(outputPtr, config.blockSize);
+            // Filter state left from the last note may still ring faintly
+            for (float s : output) sounded = sounded || std::fabs(s) > 1e-3f;
+            if (!sounded) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        synth.noteOff(60);
+        for (int b = 0; b < releaseBlocks && synth.activeVoiceCount() > 0; ++b) {
+            synth.processBuffer(outputPtr, config.blockSize);
+        }
+        const WavetableStats tables = synth.wavetableStats();
+        std::printf("note %d, key %d    : %s (%llu loads, %llu evictions)\n", note + 1, key,
+                    sounded ? "sounded" : "SILENT", static_cast<unsigned long long>(tables.loads),
+                    static_cast<unsigned long long>(tables.evictions));
+        allSounded = allSounded && sounded;
+    }
+    return allSounded ? 0 : 1;
+}
+
+// A one-shot ramp from 0 up to nearly 1, played slowed down from its start
+// in every format and tier. Taps before the start must read silence; reading
+// the table's end instead would pull the first samples towards 1.
+int checkInterp() {
+    static const char* const kTiers[] = {"linear", "hermite", "sinc"};
+    static const char* const kFormats[] = {"float", "int16", "half"};
+    const int size = 4096;
+    const int frames = 32;
+    std::vector<float> ramp(size);
+    for (int i = 0; i < size; ++i) ramp[i] = static_cast<float>(i) / size;
+
+    bool allMatch = true;
+    for (int f = 0; f <= static_cast<int>(SampleFormat::Half); ++f) {
+        const SampleFormat format = static_cast<SampleFormat>(f);
+        std::vector<float> storage(Wavetable::storageFor(size, format));
+        Wavetable table(storage.data(), size, format);
+        table.finalize(ramp.data());
+        float linear[frames];
+        for (int tier = 0; tier <= static_cast<int>(Interpolation::Sinc); ++tier) {
+            OscTable read = table.read(0.0f);
+            read.interpolation = static_cast<Interpolation>(tier);
+            float out[frames];
+            float pos = 0.0f;
+            renderWavetable(read, 0.37f, pos, false, out, frames);
+            if (tier == 0) std::copy(out, out + frames, linear);
+            float worst = 0.0f;
+            for (int i = 0; i < frames; ++i) worst = std::max(worst, std::fabs(out[i] - linear[i]));
+            const bool match = worst < 1e-3f;
+            if (tier > 0) {
+                std::printf("one-shot start    : %-5s %-7s off linear by %.2e %s\n", kFormats[f], kTiers[tier],
+                            worst, match ? "ok" : "FAIL");
+            }
+            allMatch = allMatch && match;
+        }
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Frequency of A4 on a one-cycle sine, from the spacing of its rising zero
+// crossings over a second once the attack is done
+float measurePitch(float sampleRate) {
+    PolySynth synth(sampleRate);
+    const int size = 2048;
+    float* sine = synth.beginWavetable(size);
+    for (int i = 0; i < size; ++i) sine[i] = std::sin(6.2831853f * i / size);
+    synth.commitWavetable(1);
+    synth.setProperty(Param::Wave1, 1);
+    synth.setProperty(Param::Osc2Enabled, 0);
+    synth.setProperty(Param::AmpAttack, 0.0f);
+    synth.setProperty(Param::AutoPanWidth, 0.0f);
+    synth.noteOn(69, 1.0f);
+
+    const int block = synth.maxBlockSize();
+    const int skip = static_cast<int>(0.1f * sampleRate);
+    const int frames = skip + static_cast<int>(sampleRate);
+    std::vector<float> left(frames), right(frames);
+    for (int done = 0; done < frames; done += block) {
+        const int n = std::min(block, frames - done);
+        synth.processPlanar(reinterpret_cast<uintptr_t>(&left[done]), reinterpret_cast<uintptr_t>(&right[done]), n);
+    }
+    double first = -1.0, last = 0.0;
+    int cycles = -1;
+    for (int i = skip; i < frames; ++i) {
+        if (left[i - 1] < 0.0f && left[i] >= 0.0f) {
+            const double crossing = i - 1 + left[i - 1] / (left[i - 1] - left[i]);
+            if (first < 0.0) first = crossing;
+            last = crossing;
+            ++cycles;
+        }
+    }
+    return cycles > 0 ? static_cast<float>(cycles * sampleRate / (last - first)) : 0.0f;
+}
+
+int checkPitch() {
+    const float rates[] = {44100.0f, 48000.0f, 96000.0f};
+    const float reference = measurePitch(rates[0]);
+    bool allMatch = reference > 0.0f;
+    for (float rate : rates) {
+        const float hz = rate == rates[0] ? reference : measurePitch(rate);
+        const bool match = std::fabs(hz / reference - 1.0f) < 1e-3f;
+        std::printf("A4 @ %5.0f Hz     : %.2f Hz %s\n", rate, hz, match ? "ok" : "FAIL");
+        allMatch = allMatch && match;
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Latency a host block adds against what it buys in throughput
+int sweepBlocks(const BenchConfig& config) {
+    std::printf("%.1f s @ %.0f Hz, %d voices (polyphony %d), %d thread(s)\n",
+                config.seconds, config.sampleRate, config.voices, config.polyphony, config.threads);
+    std::printf("%6s %12s %16s %10s %14s\n", "block", "latency ms", "ns/sample/voice", "realtime", "worst block %");
+    for (int block = 32; block <= 1024; block *= 2) {
+        BenchConfig run = config;
+        run.blockSize = block;
+        RenderStats stats = render(run);
+        double audioNs = stats.frames / config.sampleRate * 1e9;
+        double deadlineNs = block / config.sampleRate * 1e9;
+        double nsPerVoiceSample = stats.voiceSamples > 0 ? stats.elapsedNs / stats.voiceSamples : 0.0;
+        std::printf("%6d %12.2f %16.2f %9.1fx %14.1f\n", block, deadlineNs / 1e6, nsPerVoiceSample,
+                    audioNs / stats.elapsedNs, 100.0 * stats.worstBlockNs / deadlineNs);
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::fprintf(stderr, "usage: ziggy-bench [--seconds N] [--voices N] [--polyphony N] [--block N] [--rate HZ] [--threads N]\n"
+                             "                   [--planar] [--blocks-per-call N] [--sweep-blocks] [--random-midi] [--unison N]\n"
+                             "                   [--wave FILE] [--wave-format float|int16|half] [--routes N] [--sweep-routes]\n"
+                             "                   [--interp linear|hermite|sinc] [--sweep-interp] [--check-cache]\n"
+                             "                   [--check-interp] [--check-pitch] [--write-wave FILE]\n");
+        return 1;
+    }
+    if (config.writeWave) {
+        if (!writeWave(config.writeWave)) {
+            std::fprintf(stderr, "cannot write %s\n", config.writeWave);
+            return 1;
+        }
+        std::printf("wrote             : %s\n", config.writeWave);
+        return 0;
+    }
+    if (config.wave && !prepareWave(config)) return 1;
+    if (config.sweepBlocks) return sweepBlocks(config);
+    if (config.sweepRoutes) return sweepRoutes(config);
+    if (config.sweepInterp) return sweepInterp(config);
+    if (config.checkInterp) return checkInterp();
+    if (config.checkPitch) return checkPitch();
+    if (config.checkCache) {
+        if (!config.wave) {
+            std::fprintf(stderr, "--check-cache needs --wave\n");
+            return 1;
+        }
+        return checkCache(config);
+    }
+    if (config.randomMidi) return randomMidi(config);
+    if (config.waveFormat != SampleFormat::Float32) return compareFormats(config);
+
+    RenderStats stats = render(config);
+
+    double audioNs = stats.frames / config.sampleRate * 1e9;
+    double nsPerVoiceSample = stats.voiceSamples > 0 ? stats.elapsedNs / stats.voiceSamples : 0.0;
+
+    std::printf("rendered          : %.1f s @ %.0f Hz, block %d, %d voices (polyphony %d), %d thread(s)\n",
+                config.seconds, config.sampleRate, config.blockSize, config.voices, config.polyphony, config.threads);
+    std::printf("output            : %s, %d block(s) per call\n",
+                config.planar || config.blocksPerCall > 1 ? "planar" : "interleaved", config.blocksPerCall);
+    std::printf("render time       : %.1f ms\n", stats.elapsedNs / 1e6);
+    std::printf("ns/sample/voice   : %.2f\n", nsPerVoiceSample);
+    std::printf("peak voices       : %d\n", stats.peakVoices);
+    std::printf("realtime factor   : %.1fx\n", audioNs / stats.elapsedNs);
+    std::printf("worst block       : %.1f%% of its %.2f ms deadline\n",
+                100.0 * stats.worstBlockNs / (config.blockSize / config.sampleRate * 1e9),
+                config.blockSize / config.sampleRate * 1e3);
+    std::printf("checksum          : %.6f\n", stats.checksum);
+    std::printf("output hash       : %016llx\n", static_cast<unsigned long long>(stats.outputHash));
+    const EngineCounters& c = stats.counters;
+    std::printf("idle segments     : %llu of %llu\n", static_cast<unsigned long long>(c.idleSegments),
+                static_cast<unsigned long long>(c.segments));
+    std::printf("silent voice skips: %llu of %llu voice blocks\n",
+                static_cast<unsigned long long>(c.silentVoiceBlocks), static_cast<unsigned long long>(c.voiceBlocks));
+    std::printf("notes started     : %llu of %lld, %llu stolen voices\n", static_cast<unsigned long long>(c.notes),
+                static_cast<long long>(stats.notesQueued), static_cast<unsigned long long>(c.steals));
+    if (c.notes != static_cast<uint64_t>(stats.notesQueued)) return 1;
+
+    if (config.threads > 1) {
+        BenchConfig serial = config;
+        serial.threads = 1;
+        bool match = render(serial).outputHash == stats.outputHash;
+        std::printf("matches serial    : %s\n", match ? "yes" : "NO");
+        if (!match) return 1;
+    }
+    return 0;
+}
@@ -6,11 +6,28 @@ if [ ! -d $DIR ]; then
   mkdir -p $DIR
 fi
 
+# ZIGGY_THREADS=N builds with pthreads (SharedArrayBuffer memory) and a pool
+# of N pre-spawned workers for PolySynth::setRenderThreads, plus one for the
+# wavetable loader. Workers can only be spawned where Worker is available
+# (e.g. an offline render in a Web Worker); the page must be cross-origin
+# isolated for SharedArrayBuffer.
+THREAD_FLAGS=""
+if [ -n "$ZIGGY_THREADS" ]; then
+  THREAD_FLAGS="-pthread -s PTHREAD_POOL_SIZE=$((ZIGGY_THREADS + 1))"
+fi
+
+# Wavetables arrive as the compressed .ogg files and decode in the engine
+# (cpp/audio_decoder.cpp), against emscripten's libvorbis port. With
+# ZIGGY_THREADS the decoding runs on a worker thread; without, in the
+# worklet's message handler, between render calls.
+VORBIS_FLAGS="-s USE_OGG=1 -s USE_VORBIS=1 -DZIGGY_VORBIS=1"
+
 # NOTE `-std`: To use modern c++11 features like std::tuple and std::vector,
 # we need to enable C++ 11 by passing the parameter to gcc through emcc.
 emcc cpp/*.cpp \
   -std=c++17 \
   -O3 \
+  -msimd128 \
   -s WASM=1 \
   -s ALLOW_MEMORY_GROWTH=1 \
   -s WASM_ASYNC_COMPILATION=0 \
@@ -19,6 +36,8 @@ emcc cpp/*.cpp \
   -s EXPORTED_RUNTIME_METHODS='["ccall","cwrap"]' \
   -s EXPORTED_FUNCTIONS='["_malloc","_free"]' \
   --bind \
+  $VORBIS_FLAGS \
+  $THREAD_FLAGS \
   -o $DIR/main.js
 
 # NOTE: We concate the emscripten generated js and wasm file with the worklet
@@ -0,0 +1,67 @@
+#include "alloc_audit.h"
+
+#if ZIGGY_ALLOC_AUDIT
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Plain zero-initialised thread-locals: no dynamic initialisation, so
+// touching them from inside operator new can't recurse
+thread_local int realtimeDepth = 0;
+std::atomic<uint64_t> violations{0};
+
+void* allocate(std::size_t size) {
+    if (realtimeDepth > 0) {
+        violations.fetch_add(1, std::memory_order_relaxed);
+        assert(!"heap allocation on the audio thread");
+    }
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t align) {
+    if (realtimeDepth > 0) {
+        violations.fetch_add(1, std::memory_order_relaxed);
+        assert(!"heap allocation on the audio thread");
+    }
+    std::size_t alignment = static_cast<std::size_t>(align);
+    // aligned_alloc wants a size that's a multiple of the alignment
+    std::size_t rounded = (size + alignment - 1) / alignment * alignment;
+    void* p = std::aligned_alloc(alignment, rounded ? rounded : alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+}
+
+namespace allocaudit {
+
+void enter() { ++realtimeDepth; }
+void leave() { --realtimeDepth; }
+
+}
+
+void enableRealtimeCheck() { allocaudit::enter(); }
+
+uint64_t realtimeAllocationCount() { return violations.load(std::memory_order_relaxed); }
+
+// The array and nothrow forms forward to these
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return allocateAligned(size, align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+#else
+
+void enableRealtimeCheck() {}
+
+uint64_t realtimeAllocationCount() { return 0; }
+
+#endif
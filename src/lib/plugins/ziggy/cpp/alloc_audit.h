@@ -0,0 +1,46 @@
+#pragma once
+
+// Debug check that the audio path never touches the heap. With
+// ZIGGY_ALLOC_AUDIT defined (native Debug builds, or -DZIGGY_ALLOC_AUDIT=ON)
+// the global operator new is replaced by a counting one, and an allocation
+// made while the calling thread is inside a ScopedRealtimeCheck is counted
+// as a violation and trips an assert. Without it everything here compiles
+// away.
+
+#include <cstdint>
+
+#if ZIGGY_ALLOC_AUDIT
+namespace allocaudit {
+void enter();
+void leave();
+}
+constexpr bool kAllocAudit = true;
+#else
+constexpr bool kAllocAudit = false;
+#endif
+
+// Marks the calling thread as rendering while in scope; nests
+class ScopedRealtimeCheck {
+public:
+    ScopedRealtimeCheck() {
+#if ZIGGY_ALLOC_AUDIT
+        allocaudit::enter();
+#endif
+    }
+    ~ScopedRealtimeCheck() {
+#if ZIGGY_ALLOC_AUDIT
+        allocaudit::leave();
+#endif
+    }
+
+    ScopedRealtimeCheck(const ScopedRealtimeCheck&) = delete;
+    ScopedRealtimeCheck& operator=(const ScopedRealtimeCheck&) = delete;
+};
+
+// Marks the calling thread as rendering for good, for threads that only
+// ever run engine code
+void enableRealtimeCheck();
+
+// Allocations made on threads while marked as rendering, across all
+// threads since start-up. Always 0 without the audit.
+uint64_t realtimeAllocationCount();
@@ -0,0 +1,154 @@
+#include "audio_decoder.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef ZIGGY_VORBIS
+#include <vorbis/vorbisfile.h>
+#endif
+
+namespace {
+
+uint32_t readU16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t readU32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+bool hasTag(const uint8_t* p, const char* tag) { return std::memcmp(p, tag, 4) == 0; }
+
+constexpr uint32_t kWavePcm = 1;
+constexpr uint32_t kWaveFloat = 3;
+constexpr uint32_t kWaveExtensible = 0xfffe;
+
+bool isWave(const uint8_t* data, size_t size) {
+    return size >= 12 && hasTag(data, "RIFF") && hasTag(data + 8, "WAVE");
+}
+
+bool decodeWave(const uint8_t* data, size_t size, std::vector<float>& out) {
+    uint32_t format = 0, channels = 0, bits = 0;
+    const uint8_t* samples = nullptr;
+    size_t sampleBytes = 0;
+
+    // Chunks are word aligned; fmt comes before data in any file we accept
+    size_t at = 12;
+    while (at + 8 <= size) {
+        const uint8_t* chunk = data + at;
+        size_t length = std::min<size_t>(readU32(chunk + 4), size - at - 8);
+        if (hasTag(chunk, "fmt ") && length >= 16) {
+            format = readU16(chunk + 8);
+            channels = readU16(chunk + 10);
+            bits = readU16(chunk + 22);
+            // The real format is the first word of the sub-format GUID
+            if (format == kWaveExtensible && length >= 26) format = readU16(chunk + 32);
+        } else if (hasTag(chunk, "data")) {
+            samples = chunk + 8;
+            sampleBytes = length;
+            break;
+        }
+        at += 8 + length + (length & 1);
+    }
+
+    const bool integer = format == kWavePcm && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+    const bool floating = format == kWaveFloat && bits == 32;
+    if (!samples || channels == 0 || !(integer || floating)) return false;
+
+    const size_t bytes = bits / 8;
+    const size_t frameBytes = bytes * channels;
+    const size_t frames = sampleBytes / frameBytes;
+    out.resize(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        const uint8_t* p = samples + i * frameBytes;
+        if (floating) {
+            uint32_t word = readU32(p);
+            std::memcpy(&out[i], &word, sizeof(float));
+        } else if (bits == 8) {
+            out[i] = (static_cast<int>(p[0]) - 128) / 128.0f;
+        } else {
+            // Left-align in 32 bits so the sign lands in the top bit
+            uint32_t word = 0;
+            for (size_t b = 0; b < bytes; ++b) word |= static_cast<uint32_t>(p[b]) << (32 - 8 * (bytes - b));
+            out[i] = static_cast<int32_t>(word) / 2147483648.0f;
+        }
+    }
+    return !out.empty();
+}
+
+#ifdef ZIGGY_VORBIS
+
+// vorbisfile reads through these from the bytes in memory
+struct MemoryFile {
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+};
+
+size_t readMemory(void* buffer, size_t size, size_t count, void* source) {
+    MemoryFile& file = *static_cast<MemoryFile*>(source);
+    size_t bytes = std::min(size * count, file.size - file.position);
+    std::memcpy(buffer, file.data + file.position, bytes);
+    file.position += bytes;
+    return size ? bytes / size : 0;
+}
+
+int seekMemory(void* source, ogg_int64_t offset, int whence) {
+    MemoryFile& file = *static_cast<MemoryFile*>(source);
+    ogg_int64_t base = whence == SEEK_CUR ? static_cast<ogg_int64_t>(file.position)
+                     : whence == SEEK_END ? static_cast<ogg_int64_t>(file.size) : 0;
+    ogg_int64_t position = base + offset;
+    if (position < 0 || position > static_cast<ogg_int64_t>(file.size)) return -1;
+    file.position = static_cast<size_t>(position);
+    return 0;
+}
+
+long tellMemory(void* source) {
+    return static_cast<long>(static_cast<MemoryFile*>(source)->position);
+}
+
+bool isOgg(const uint8_t* data, size_t size) { return size >= 4 && hasTag(data, "OggS"); }
+
+bool decodeVorbis(const uint8_t* data, size_t size, std::vector<float>& out) {
+    MemoryFile memory = {data, size, 0};
+    const ov_callbacks callbacks = {readMemory, seekMemory, nullptr, tellMemory};
+    OggVorbis_File file;
+    if (ov_open_callbacks(&memory, &file, nullptr, 0, callbacks) < 0) return false;
+
+    ogg_int64_t total = ov_pcm_total(&file, -1);
+    if (total > 0) out.reserve(static_cast<size_t>(total));
+
+    bool ok = true;
+    for (;;) {
+        float** pcm = nullptr;
+        int section = 0;
+        long frames = ov_read_float(&file, &pcm, 4096, &section);
+        if (frames == 0) break;
+        // A hole is a gap in the stream, not the end of it
+        if (frames == OV_HOLE) continue;
+        if (frames < 0) {
+            ok = false;
+            break;
+        }
+        out.insert(out.end(), pcm[0], pcm[0] + frames);
+    }
+    ov_clear(&file);
+    return ok && !out.empty();
+}
+
+#endif
+
+}
+
+bool decodeAudio(const uint8_t* data, size_t size, std::vector<float>& out) {
+    out.clear();
+    if (!data) return false;
+    if (isWave(data, size)) return decodeWave(data, size, out);
+#ifdef ZIGGY_VORBIS
+    if (isOgg(data, size)) return decodeVorbis(data, size, out);
+#endif
+    return false;
+}
+
+bool canDecodeVorbis() {
+#ifdef ZIGGY_VORBIS
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decodes an encoded audio file held in memory to the samples of its first
+// channel, replacing out's contents. Sample rates are not converted: a
+// wavetable is a sequence of samples, whatever rate it was saved at.
+//
+// Ogg/Vorbis needs a build with libvorbisfile (ZIGGY_VORBIS; build.sh uses
+// emscripten's port, CMake finds it with pkg-config). RIFF WAVE with 8/16/24/32
+// bit integer or 32-bit float samples always decodes, so native renders can
+// load waves without it.
+//
+// Allocates, so never call it from the render path.
+bool decodeAudio(const uint8_t* data, size_t size, std::vector<float>& out);
+
+// Whether this build can decode Ogg/Vorbis
+bool canDecodeVorbis();
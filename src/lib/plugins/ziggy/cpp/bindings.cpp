@@ -20,37 +20,101 @@ using namespace emscripten;
 //         .function("setFilterResonance", &Synth::setFilterResonance);
 // }
 
-// Helper function to convert JS Float32Array to std::vector<float>
+// Copies a JS Float32Array into engine memory with a single HEAPF32.set
 void loadWavetableHelper(PolySynth& synth, float key, const val& array) {
-    size_t length = array["length"].as<size_t>();
-    std::vector<float> wavetable(length);
+    int length = array["length"].as<int>();
+    float* samples = synth.beginWavetable(length);
+    if (!samples) return;
     
-    // Directly copy values from the array
-    for (size_t i = 0; i < length; i++) {
-        wavetable[i] = array[i].as<float>();
-    }
-    
-    synth.loadWavetable(key, wavetable);
+    val heap = val::module_property("HEAPF32");
+    heap.call<void>("set", array, reinterpret_cast<uintptr_t>(samples) / sizeof(float));
+    synth.commitWavetable(key);
+}
+
+// Encoded file bytes (a Uint8Array) for the engine to decode in the
+// background; one HEAPU8.set into the buffer the loader keeps. format is a
+// SampleFormat: 0 float, 1 int16, 2 half.
+void loadEncodedWavetableHelper(PolySynth& synth, float key, const val& bytes, int format) {
+    std::vector<uint8_t> encoded(bytes["length"].as<size_t>());
+    if (encoded.empty()) return;
+
+    val heap = val::module_property("HEAPU8");
+    heap.call<void>("set", bytes, reinterpret_cast<uintptr_t>(encoded.data()));
+    if (format < 0 || format > static_cast<int>(SampleFormat::Half)) format = 0;
+    synth.loadEncodedWavetable(key, std::move(encoded), static_cast<SampleFormat>(format));
 }
 
-// Helper function to convert JS object to std::map
+// Zero-copy path: JS writes straight into the returned heap address
+uintptr_t beginWavetableHelper(PolySynth& synth, int length) {
+    return reinterpret_cast<uintptr_t>(synth.beginWavetable(length));
+}
+
+// Resolve each JS property name to its Param once, at control rate, so the
+// render path only ever sees flat parameter IDs
 void setPropertiesHelper(PolySynth& synth, const val& obj) {
-    std::map<std::string, float> props;
-    
     // Get all enumerable properties from the object
     val keys = val::global("Object").call<val>("keys", obj);
     int length = keys["length"].as<int>();
     
     for (int i = 0; i < length; i++) {
         std::string key = keys[i].as<std::string>();
-        float value = obj[key].as<float>();
-        props[key] = value;
+        Param id;
+        if (paramFromName(key, id)) {
+            synth.setProperty(id, obj[key].as<float>());
+        }
     }
-    
-    synth.setProperties(props);
+}
+
+// Param id for a property name, or -1. JS caches these so events can be
+// written straight into the queue.
+int paramIdHelper(const std::string& name) {
+    Param id;
+    return paramFromName(name, id) ? static_cast<int>(id) : -1;
+}
+
+// Event queue layout in the WASM heap
+uintptr_t eventBufferPtr(PolySynth& synth) { return synth.events().bufferPtr(); }
+uintptr_t eventWriteIndexPtr(PolySynth& synth) { return synth.events().writeIndexPtr(); }
+uintptr_t eventReadIndexPtr(PolySynth& synth) { return synth.events().readIndexPtr(); }
+uint32_t eventCapacity(PolySynth& synth) { return synth.events().capacity(); }
+
+// Fast-path counters as a plain object; uint64 counts go out as doubles
+val countersHelper(PolySynth& synth) {
+    const EngineCounters& c = synth.counters();
+    val result = val::object();
+    result.set("blocks", static_cast<double>(c.blocks));
+    result.set("segments", static_cast<double>(c.segments));
+    result.set("idleSegments", static_cast<double>(c.idleSegments));
+    result.set("voiceBlocks", static_cast<double>(c.voiceBlocks));
+    result.set("silentVoiceBlocks", static_cast<double>(c.silentVoiceBlocks));
+    result.set("notes", static_cast<double>(c.notes));
+    result.set("steals", static_cast<double>(c.steals));
+    return result;
+}
+
+// Wavetable cache stats, the same way
+val wavetableStatsHelper(PolySynth& synth) {
+    const WavetableStats stats = synth.wavetableStats();
+    val result = val::object();
+    result.set("hits", static_cast<double>(stats.hits));
+    result.set("misses", static_cast<double>(stats.misses));
+    result.set("loads", static_cast<double>(stats.loads));
+    result.set("evictions", static_cast<double>(stats.evictions));
+    result.set("failures", static_cast<double>(stats.failures));
+    result.set("bytes", static_cast<double>(stats.bytes));
+    result.set("budget", static_cast<double>(stats.budget));
+    result.set("encodedBytes", static_cast<double>(stats.encodedBytes));
+    result.set("tables", stats.tables);
+    return result;
+}
+
+void setWavetableBudgetHelper(PolySynth& synth, double bytes) {
+    synth.setWavetableBudget(bytes > 0 ? static_cast<size_t>(bytes) : 0);
 }
 
 EMSCRIPTEN_BINDINGS(polysynth_module) {
+    function("paramId", &paramIdHelper);
+
     // enum_<Synth::Waveform>("Waveform")
     //     .value("Sine", Synth::Waveform::Sine)
     //     .value("Square", Synth::Waveform::Square)
@@ -58,11 +122,31 @@ EMSCRIPTEN_BINDINGS(polysynth_module) {
 
     class_<PolySynth>("PolySynth")
         .constructor<float, int>()
+        .constructor<float, int, int>()
         // .function("process", &PolySynth::process)
         .function("processBuffer", &PolySynth::processBuffer)
+        .function("processPlanar", &PolySynth::processPlanar)
+        .function("processBlocks", &PolySynth::processBlocks)
         .function("noteOn", &PolySynth::noteOn)
         .function("noteOff", &PolySynth::noteOff)
         .function("loadWavetable", &loadWavetableHelper)
+        .function("beginWavetable", &beginWavetableHelper)
+        .function("commitWavetable", &PolySynth::commitWavetable)
+        .function("loadEncodedWavetable", &loadEncodedWavetableHelper)
+        .function("pendingWavetables", &PolySynth::pendingWavetables)
+        .function("failedWavetables", &PolySynth::failedWavetables)
+        .function("preloadWavetable", &PolySynth::preloadWavetable)
+        .function("serviceWavetables", &PolySynth::serviceWavetables)
+        .function("setWavetableBudget", &setWavetableBudgetHelper)
+        .function("wavetableStats", &wavetableStatsHelper)
+        .function("setRenderThreads", &PolySynth::setRenderThreads)
+        .function("maxBlockSize", &PolySynth::maxBlockSize)
+        .function("eventBufferPtr", &eventBufferPtr)
+        .function("eventWriteIndexPtr", &eventWriteIndexPtr)
+        .function("eventReadIndexPtr", &eventReadIndexPtr)
+        .function("eventCapacity", &eventCapacity)
+        .function("counters", &countersHelper)
+        .function("resetCounters", &PolySynth::resetCounters)
         // .function("setProperty", &PolySynth::setProperty)
         .function("setProperties", &setPropertiesHelper);
         // .function("getProperty", &PolySynth::getProperty);
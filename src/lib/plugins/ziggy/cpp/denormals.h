@@ -0,0 +1,47 @@
+#pragma once
+
+// Flush-to-zero / denormals-are-zero for the calling thread. Decaying filter
+// state drifts into denormal range, where x86 takes a microcode assist of
+// ~100 cycles per operation. WebAssembly has no such mode (and other
+// targets are left alone); there the voice bank flushes its filter state
+// explicitly instead, see VoiceBank::processLanes.
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__wasm__)
+    #include <xmmintrin.h>
+    #define ZIGGY_HAVE_FTZ 1
+#endif
+
+#if ZIGGY_HAVE_FTZ
+// MXCSR flush-to-zero and denormals-are-zero bits
+constexpr unsigned kDenormalFlushBits = 0x8040;
+#endif
+
+// Sets FTZ/DAZ while in scope and restores the caller's mode afterwards, for
+// code running on a host's audio thread
+class ScopedDenormalFlush {
+public:
+    ScopedDenormalFlush() {
+#if ZIGGY_HAVE_FTZ
+        saved = _mm_getcsr();
+        _mm_setcsr(saved | kDenormalFlushBits);
+#endif
+    }
+    ~ScopedDenormalFlush() {
+#if ZIGGY_HAVE_FTZ
+        _mm_setcsr(saved);
+#endif
+    }
+
+    ScopedDenormalFlush(const ScopedDenormalFlush&) = delete;
+    ScopedDenormalFlush& operator=(const ScopedDenormalFlush&) = delete;
+
+private:
+    unsigned saved = 0;
+};
+
+// Sets FTZ/DAZ for good, for threads that only ever run engine code
+inline void enableDenormalFlush() {
+#if ZIGGY_HAVE_FTZ
+    _mm_setcsr(_mm_getcsr() | kDenormalFlushBits);
+#endif
+}
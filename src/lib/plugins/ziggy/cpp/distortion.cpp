@@ -0,0 +1,295 @@
+#include "distortion.h"
+#include <algorithm>
+#include <cmath>
+#include "fast_math.h"
+#include "simd.h"
+
+using namespace simd;
+
+namespace {
+
+// First stage passes up to about 0.39 of the base rate at roughly -70 dB
+// stopband. The second stage of 4x only has to clear the band the first
+// stage removes anyway, so it can be much shorter.
+constexpr int kTaps2x = 12;
+constexpr int kTaps4x = 6;
+constexpr double kKaiserBeta = 7.0;
+
+constexpr float kHalfPi = 1.57079632679f;
+constexpr float kTwoOverPi = 0.63661977236f;
+
+// Steps in the driven signal below this lose too much precision in the
+// ADAA difference quotient; the midpoint value is used instead
+constexpr float kAdaaEpsilon = 1e-2f;
+
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser-windowed halfband lowpass. Returns the taps at odd offsets from the
+// centre, outermost first; the centre tap is 0.5 and the rest are zero.
+std::vector<float> halfbandTaps(int taps) {
+    const int outer = 2 * taps - 1;
+    std::vector<double> h(2 * taps);
+    double sum = 0.0;
+    for (int k = 0; k < 2 * taps; ++k) {
+        int offset = outer - 2 * k;
+        double r = static_cast<double>(offset) / (outer + 1);
+        double window = besselI0(kKaiserBeta * std::sqrt(1.0 - r * r)) / besselI0(kKaiserBeta);
+        h[k] = std::sin(M_PI * offset / 2.0) / (M_PI * offset) * window;
+        sum += h[k];
+    }
+    // Both polyphase branches get exactly unity gain at DC
+    std::vector<float> result(2 * taps);
+    for (int k = 0; k < 2 * taps; ++k) result[k] = static_cast<float>(h[k] * 0.5 / sum);
+    return result;
+}
+
+// Four consecutive outputs of a symmetric FIR with 2 * taps coefficients,
+// oldest input first. Mirrored inputs share a multiply, and two accumulators
+// halve the add chain.
+f32x4 symmetricFir(const float* coeffs, int taps, const float* x) {
+    const int last = 2 * taps - 1;
+    f32x4 acc0 = set1(0.0f), acc1 = set1(0.0f);
+    int k = 0;
+    for (; k + 2 <= taps; k += 2) {
+        acc0 = madd(set1(coeffs[k]), add(load(x + k), load(x + last - k)), acc0);
+        acc1 = madd(set1(coeffs[k + 1]), add(load(x + k + 1), load(x + last - k - 1)), acc1);
+    }
+    if (k < taps) acc0 = madd(set1(coeffs[k]), add(load(x + k), load(x + last - k)), acc0);
+    return add(acc0, acc1);
+}
+
+f32x4 absolute(f32x4 x) { return max(x, sub(set1(0.0f), x)); }
+
+template <Distortion::Shape S>
+struct Curve;
+
+template <>
+struct Curve<Distortion::Shape::HardClip> {
+    static f32x4 apply(f32x4 u) { return min(max(u, set1(-1.0f)), set1(1.0f)); }
+    static f32x4 integral(f32x4 u) {
+        f32x4 a = absolute(u);
+        return select(cmplt(a, set1(1.0f)), mul(set1(0.5f), mul(u, u)), sub(a, set1(0.5f)));
+    }
+};
+
+template <>
+struct Curve<Distortion::Shape::SoftClip> {
+    static f32x4 apply(f32x4 u) { return fastmath::tanh(u); }
+    // log(cosh(u)), written so it can't overflow
+    static f32x4 integral(f32x4 u) {
+        f32x4 a = absolute(u);
+        f32x4 tail = fastmath::log2(add(set1(1.0f), fastmath::exp(mul(a, set1(-2.0f)))));
+        return madd(set1(fastmath::kLn2), tail, sub(a, set1(fastmath::kLn2)));
+    }
+};
+
+template <>
+struct Curve<Distortion::Shape::Fold> {
+    static f32x4 apply(f32x4 u) { return fastmath::sin(mul(u, set1(kHalfPi))); }
+    static f32x4 integral(f32x4 u) {
+        return mul(sub(set1(1.0f), fastmath::cos(mul(u, set1(kHalfPi)))), set1(kTwoOverPi));
+    }
+};
+
+// Runs kernel over data four samples at a time; the tail goes through a
+// padded copy so nothing past frames is touched
+template <typename Kernel>
+void forEachVector(float* data, int frames, Kernel kernel) {
+    int i = 0;
+    for (; i + 4 <= frames; i += 4) store(data + i, kernel(load(data + i), i));
+    if (i < frames) {
+        alignas(16) float tail[4] = {};
+        std::copy(data + i, data + frames, tail);
+        store(tail, kernel(load(tail), i));
+        std::copy(tail, tail + (frames - i), data + i);
+    }
+}
+
+// data = wet * f(gain * data) + dry * data
+template <Distortion::Shape S>
+void shapeBlock(float* data, int frames, float gain, float wet, float dry) {
+    const f32x4 g = set1(gain), w = set1(wet), d = set1(dry);
+    forEachVector(data, frames, [&](f32x4 x, int) { return madd(w, Curve<S>::apply(mul(g, x)), mul(d, x)); });
+}
+
+void shapeBlock(Distortion::Shape shape, float* data, int frames, float gain, float wet, float dry) {
+    switch (shape) {
+        case Distortion::Shape::HardClip: shapeBlock<Distortion::Shape::HardClip>(data, frames, gain, wet, dry); break;
+        case Distortion::Shape::SoftClip: shapeBlock<Distortion::Shape::SoftClip>(data, frames, gain, wet, dry); break;
+        case Distortion::Shape::Fold: shapeBlock<Distortion::Shape::Fold>(data, frames, gain, wet, dry); break;
+    }
+}
+
+// driven holds frames + 1 samples of gain * x, the first one from the
+// previous block, then padding. Each output is the mean of f over the step
+// between neighbouring samples, (F(u1) - F(u0)) / (u1 - u0); the dry part
+// gets the same mean of x.
+template <Distortion::Shape S>
+void adaaBlock(float* buffer, int frames, float* driven, float* integral, float gain, float wet, float dry) {
+    // The last vector reads up to four samples past frames
+    const int padded = (frames + 8) & ~3;
+    for (int j = 0; j < padded; j += 4) store(integral + j, Curve<S>::integral(load(driven + j)));
+
+    const f32x4 w = set1(wet), dryScale = set1(dry / gain);
+    const f32x4 one = set1(1.0f), half = set1(0.5f), epsilon = set1(kAdaaEpsilon);
+    forEachVector(buffer, frames, [&](f32x4, int i) {
+        f32x4 u0 = load(driven + i), u1 = load(driven + i + 1);
+        f32x4 step = sub(u1, u0);
+        f32x4 mid = mul(add(u0, u1), half);
+        f32x4 flat = cmplt(absolute(step), epsilon);
+        f32x4 slope = div(sub(load(integral + i + 1), load(integral + i)), select(flat, one, step));
+        f32x4 shaped = select(flat, Curve<S>::apply(mid), slope);
+        return madd(w, shaped, mul(dryScale, mid));
+    });
+}
+
+}
+
+HalfbandUp::HalfbandUp(int taps, int maxFrames)
+    : taps(taps), coeffs(halfbandTaps(taps)), history(2 * taps - 1 + maxFrames, 0.0f) {
+    // Zero stuffing halves the level; the taps make it back up
+    for (float& c : coeffs) c *= 2.0f;
+}
+
+void HalfbandUp::reset() { std::fill(history.begin(), history.end(), 0.0f); }
+
+void HalfbandUp::process(const float* in, float* out, int frames) {
+    const int past = 2 * taps - 1;
+    float* x = history.data();
+    std::copy(in, in + frames, x + past);
+
+    // Even outputs are the FIR branch, odd ones the centre tap: a delay
+    int n = 0;
+    for (; n + 4 <= frames; n += 4) {
+        f32x4 lo, hi;
+        interleave(symmetricFir(coeffs.data(), taps, x + n), load(x + n + taps), lo, hi);
+        store(out + 2 * n, lo);
+        store(out + 2 * n + 4, hi);
+    }
+    for (; n < frames; ++n) {
+        float even = 0.0f;
+        for (int k = 0; k < 2 * taps; ++k) even += coeffs[k] * x[n + k];
+        out[2 * n] = even;
+        out[2 * n + 1] = x[n + taps];
+    }
+
+    std::copy(x + frames, x + frames + past, x);
+}
+
+HalfbandDown::HalfbandDown(int taps, int maxFrames)
+    : taps(taps), coeffs(halfbandTaps(taps)),
+      even(2 * taps - 1 + maxFrames, 0.0f), odd(2 * taps - 1 + maxFrames, 0.0f) {}
+
+void HalfbandDown::reset() {
+    std::fill(even.begin(), even.end(), 0.0f);
+    std::fill(odd.begin(), odd.end(), 0.0f);
+}
+
+void HalfbandDown::process(const float* in, float* out, int frames) {
+    const int past = 2 * taps - 1;
+    float* e = even.data();
+    float* o = odd.data();
+    for (int i = 0; i < frames; ++i) {
+        e[past + i] = in[2 * i];
+        o[past + i] = in[2 * i + 1];
+    }
+
+    int n = 0;
+    for (; n + 4 <= frames; n += 4) {
+        store(out + n, madd(set1(0.5f), load(o + n + taps - 1), symmetricFir(coeffs.data(), taps, e + n)));
+    }
+    for (; n < frames; ++n) {
+        float acc = 0.5f * o[n + taps - 1];
+        for (int k = 0; k < 2 * taps; ++k) acc += coeffs[k] * e[n + k];
+        out[n] = acc;
+    }
+
+    std::copy(e + frames, e + frames + past, e);
+    std::copy(o + frames, o + frames + past, o);
+}
+
+Distortion::Distortion(int maxFrames)
+    : up2x(kTaps2x, maxFrames), down2x(kTaps2x, maxFrames),
+      up4x(kTaps4x, 2 * maxFrames), down4x(kTaps4x, 2 * maxFrames),
+      rate2x(2 * maxFrames), rate4x(4 * maxFrames),
+      driven(maxFrames + 8), integral(maxFrames + 8) {}
+
+Distortion::Shape Distortion::shapeFor(float character) {
+    if (character < 0.33f) return Shape::HardClip;
+    if (character < 0.66f) return Shape::SoftClip;
+    return Shape::Fold;
+}
+
+Distortion::Quality Distortion::qualityFor(float quality) {
+    int q = static_cast<int>(quality + 0.5f);
+    return static_cast<Quality>(std::clamp(q, 0, 3));
+}
+
+void Distortion::reset() {
+    up2x.reset();
+    down2x.reset();
+    up4x.reset();
+    down4x.reset();
+    lastInput = 0.0f;
+}
+
+void Distortion::process(float* buffer, int frames, float amount, Shape shape, Quality quality) {
+    if (amount <= 0.0f) {
+        engaged = false;
+        return;
+    }
+    if (!engaged || quality != engagedQuality) {
+        reset();
+        engaged = true;
+        engagedQuality = quality;
+    }
+
+    const float gain = 1.0f + amount * 8.0f;
+    const float wet = amount / (1.0f + amount);
+    const float dry = 1.0f - amount;
+
+    switch (quality) {
+        case Quality::Plain:
+            shapeBlock(shape, buffer, frames, gain, wet, dry);
+            break;
+        case Quality::Adaa:
+            processAdaa(buffer, frames, shape, gain, wet, dry);
+            break;
+        case Quality::Oversample2x:
+            up2x.process(buffer, rate2x.data(), frames);
+            shapeBlock(shape, rate2x.data(), 2 * frames, gain, wet, dry);
+            down2x.process(rate2x.data(), buffer, frames);
+            break;
+        case Quality::Oversample4x:
+            up2x.process(buffer, rate2x.data(), frames);
+            up4x.process(rate2x.data(), rate4x.data(), 2 * frames);
+            shapeBlock(shape, rate4x.data(), 4 * frames, gain, wet, dry);
+            down4x.process(rate4x.data(), rate2x.data(), 2 * frames);
+            down2x.process(rate2x.data(), buffer, frames);
+            break;
+    }
+}
+
+void Distortion::processAdaa(float* buffer, int frames, Shape shape, float gain, float wet, float dry) {
+    // The previous block's last sample is driven at this block's gain, so a
+    // change of amount doesn't show up as a step
+    float* u = driven.data();
+    u[0] = gain * lastInput;
+    for (int i = 0; i < frames; ++i) u[i + 1] = gain * buffer[i];
+    lastInput = buffer[frames - 1];
+    // Repeat the last sample into the padding: flat steps, no division by 0
+    std::fill(u + frames + 1, u + driven.size(), u[frames]);
+
+    switch (shape) {
+        case Shape::HardClip: adaaBlock<Shape::HardClip>(buffer, frames, u, integral.data(), gain, wet, dry); break;
+        case Shape::SoftClip: adaaBlock<Shape::SoftClip>(buffer, frames, u, integral.data(), gain, wet, dry); break;
+        case Shape::Fold: adaaBlock<Shape::Fold>(buffer, frames, u, integral.data(), gain, wet, dry); break;
+    }
+}
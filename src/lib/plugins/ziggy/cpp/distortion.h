@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+// Halfband FIR resamplers for the oversampled distortion. Linear phase, and
+// every other tap of a halfband filter is zero, so each output phase is
+// either a short FIR or a plain delay. Each stage delays by 2 * taps - 1
+// samples at the higher rate.
+class HalfbandUp {
+public:
+    // taps: nonzero taps on each side of the centre
+    HalfbandUp(int taps, int maxFrames);
+
+    void reset();
+    // Writes 2 * frames samples to out
+    void process(const float* in, float* out, int frames);
+
+private:
+    int taps;
+    std::vector<float> coeffs;   // 2 * taps, scaled by the upsampling gain of 2
+    std::vector<float> history;  // 2 * taps - 1 past inputs, then the block
+};
+
+class HalfbandDown {
+public:
+    HalfbandDown(int taps, int maxFrames);
+
+    void reset();
+    // Reads 2 * frames samples from in
+    void process(const float* in, float* out, int frames);
+
+private:
+    int taps;
+    std::vector<float> coeffs;
+    std::vector<float> even;  // even and odd input phases, with history
+    std::vector<float> odd;
+};
+
+// Per-voice waveshaper. The shape is picked by the character parameter and
+// run one of four ways:
+//
+//   Plain         at the base rate; aliases
+//   Adaa          first-order antiderivative antialiasing, half a sample of
+//                 delay and a gentle top-end rolloff
+//   Oversample2x  halfband up, shape, halfband down; 23 samples of latency
+//   Oversample4x  two halfband stages; 28.5 samples of latency
+//
+// The dry part of the mix goes through the same path as the shaped part so
+// the two stay aligned.
+class Distortion {
+public:
+    enum class Shape { HardClip, SoftClip, Fold };
+    enum class Quality { Plain, Adaa, Oversample2x, Oversample4x };
+
+    explicit Distortion(int maxFrames = 128);
+
+    // character: 0-0.33 hard clip, 0.33-0.66 tanh, 0.66-1 sine wavefolder
+    static Shape shapeFor(float character);
+    // quality: 0 plain, 1 ADAA, 2 2x oversampled, 3 4x oversampled
+    static Quality qualityFor(float quality);
+
+    void reset();
+    // In place. amount == 0 bypasses the stage entirely; the resampler
+    // history starts from silence when it's engaged again.
+    void process(float* buffer, int frames, float amount, Shape shape, Quality quality);
+
+private:
+    void processAdaa(float* buffer, int frames, Shape shape, float gain, float wet, float dry);
+
+    HalfbandUp up2x;
+    HalfbandDown down2x;
+    HalfbandUp up4x;
+    HalfbandDown down4x;
+    std::vector<float> rate2x;  // block at 2x the base rate
+    std::vector<float> rate4x;
+
+    // ADAA: driven input with the previous block's last sample in front, and
+    // its antiderivative
+    std::vector<float> driven;
+    std::vector<float> integral;
+    float lastInput = 0.0f;
+
+    bool engaged = false;
+    Quality engagedQuality = Quality::Plain;
+};
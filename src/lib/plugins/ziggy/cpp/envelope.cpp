@@ -0,0 +1,232 @@
+#include "envelope.h"
+#include <algorithm>
+#include <cmath>
+#include "simd.h"
+
+using namespace simd;
+
+namespace {
+
+// How far past its end each curve aims, as a share of its span. A small
+// attack ratio gives a near-linear rise; the decay and release ratios make
+// them exponential down to about -60 dB.
+constexpr float kAttackRatio = 0.3f;
+constexpr float kDecayRatio = 0.001f;
+
+// End threshold of held stages
+constexpr float kNever = 1e30f;
+
+// Per-sample coefficient covering a curve's span, from 0 to 1 of it, in
+// seconds
+float segmentCoeff(float seconds, float sampleRate, float ratio) {
+    float samples = std::max(seconds * sampleRate, 1.0f);
+    return std::exp(-std::log((1.0f + ratio) / ratio) / samples);
+}
+
+}
+
+EnvelopeBank::EnvelopeBank(int voices)
+    : shapes(voices), stages(voices, Idle), levels(voices, 0.0f), peaks(voices, 0.0f), offsets(voices, 0.0f),
+      coeff(voices, 1.0f), targets(voices, 0.0f), direction(voices, 1.0f), end(voices, kNever),
+      endLevel(voices, 0.0f) {}
+
+void EnvelopeBank::setParameters(int v, float attack, float decay, float sustain, float release,
+                                 float sampleRate) {
+    Shape& s = shapes[v];
+    s.attack = segmentCoeff(attack, sampleRate, kAttackRatio);
+    s.decay = segmentCoeff(decay, sampleRate, kDecayRatio);
+    s.sustain = std::clamp(sustain, 0.0f, 1.0f);
+    // Release times are from full level; lower levels get there sooner
+    s.release = segmentCoeff(release, sampleRate, kDecayRatio);
+    s.fast = segmentCoeff(kFastReleaseSeconds, sampleRate, kDecayRatio);
+}
+
+void EnvelopeBank::enter(int v, Stage stage) {
+    const Shape& s = shapes[v];
+    stages[v] = stage;
+    switch (stage) {
+        case Attack:
+            coeff[v] = s.attack;
+            targets[v] = 1.0f + kAttackRatio;
+            direction[v] = 1.0f;
+            endLevel[v] = 1.0f;
+            break;
+        case Decay:
+            coeff[v] = s.decay;
+            targets[v] = s.sustain - kDecayRatio * (1.0f - s.sustain);
+            direction[v] = -1.0f;
+            endLevel[v] = s.sustain;
+            break;
+        case Release:
+        case FastRelease:
+            coeff[v] = stage == Release ? s.release : s.fast;
+            targets[v] = -kDecayRatio;
+            direction[v] = -1.0f;
+            endLevel[v] = 0.0f;
+            break;
+        case Sustain:
+        case Idle:
+            if (stage == Idle) levels[v] = 0.0f;
+            coeff[v] = 1.0f;
+            targets[v] = levels[v];
+            offsets[v] = 0.0f;
+            direction[v] = 1.0f;
+            end[v] = kNever;
+            return;
+    }
+    offsets[v] = levels[v] - targets[v];
+    end[v] = (endLevel[v] - targets[v]) * direction[v];
+}
+
+void EnvelopeBank::finishSegment(int v) {
+    levels[v] = endLevel[v];
+    switch (stages[v]) {
+        case Attack: enter(v, Decay); break;
+        case Decay: enter(v, Sustain); break;
+        default: enter(v, Idle); break;
+    }
+}
+
+void EnvelopeBank::noteOn(int v) { enter(v, Attack); }
+
+void EnvelopeBank::noteOff(int v) {
+    if (stages[v] != Idle && stages[v] != FastRelease) enter(v, Release);
+}
+
+void EnvelopeBank::fastRelease(int v) {
+    if (stages[v] != Idle) enter(v, FastRelease);
+}
+
+void EnvelopeBank::stop(int v) { enter(v, Idle); }
+
+void EnvelopeBank::loadLanes(const int* slots, Lanes& lanes) const {
+    for (int l = 0; l < kLanes; ++l) {
+        int v = slots[l];
+        if (v < 0) {
+            lanes.offset[l] = lanes.target[l] = 0.0f;
+            lanes.coeff[l] = lanes.direction[l] = 1.0f;
+            lanes.end[l] = kNever;
+            continue;
+        }
+        lanes.offset[l] = offsets[v];
+        lanes.coeff[l] = coeff[v];
+        lanes.target[l] = targets[v];
+        lanes.direction[l] = direction[v];
+        lanes.end[l] = end[v];
+    }
+}
+
+void EnvelopeBank::stepLanes(const int* slots, Lanes& lanes, float (*out)[kLanes], int frames) {
+    for (int l = 0; l < kLanes; ++l) {
+        int v = slots[l];
+        for (int i = 0; i < frames; ++i) {
+            lanes.offset[l] *= lanes.coeff[l];
+            if (v >= 0 && lanes.offset[l] * lanes.direction[l] >= lanes.end[l]) {
+                finishSegment(v);
+                lanes.offset[l] = offsets[v];
+                lanes.coeff[l] = coeff[v];
+                lanes.target[l] = targets[v];
+                lanes.direction[l] = direction[v];
+                lanes.end[l] = end[v];
+            }
+            out[i][l] = lanes.target[l] + lanes.offset[l];
+        }
+    }
+}
+
+void EnvelopeBank::process(const int* slots, float* out, int frames) {
+    alignas(16) Lanes lanes;
+    loadLanes(slots, lanes);
+    int live = 0;  // lanes in use, as bits
+    for (int l = 0; l < kLanes; ++l) live |= (slots[l] >= 0) << l;
+
+    f32x4 offset = load(lanes.offset), target = load(lanes.target);
+    f32x4 dir = load(lanes.direction), endV = load(lanes.end);
+    f32x4 peak = add(target, offset);
+
+    // Segments are monotonic, so if no lane's segment has ended by the last
+    // of a run of samples none has anywhere in it; only then are samples
+    // stepped one at a time, a few times per note.
+    if (!out) {
+        // Level only: jump the whole block, coeff^frames by squaring
+        f32x4 jump = set1(1.0f), c = load(lanes.coeff);
+        for (int n = frames; n > 0; n >>= 1) {
+            if (n & 1) jump = mul(jump, c);
+            c = mul(c, c);
+        }
+        f32x4 jumped = mul(offset, jump);
+        if (!(maskBits(cmpge(mul(jumped, dir), endV)) & live)) {
+            store(lanes.offset, jumped);
+            alignas(16) float level[kLanes], high[kLanes];
+            store(level, add(target, jumped));
+            store(high, max(peak, add(target, jumped)));
+            for (int l = 0; l < kLanes; ++l) {
+                int v = slots[l];
+                if (v < 0) continue;
+                offsets[v] = lanes.offset[l];
+                levels[v] = level[l];
+                peaks[v] = high[l];
+            }
+            return;
+        }
+    }
+
+    // Four samples per pass, each straight from the offset before them, so
+    // consecutive samples don't wait on one another's multiplies
+    f32x4 c1, c2, c3, c4;
+    auto loadSegments = [&]() {
+        c1 = load(lanes.coeff);
+        c2 = mul(c1, c1);
+        c3 = mul(c2, c1);
+        c4 = mul(c2, c2);
+        target = load(lanes.target);
+        dir = load(lanes.direction);
+        endV = load(lanes.end);
+    };
+    loadSegments();
+
+    alignas(16) float samples[4][kLanes];
+    for (int i = 0; i < frames; i += 4) {
+        const int run = std::min(4, frames - i);
+        f32x4 s0, s1, s2, s3;
+        f32x4 last = mul(offset, c4);
+        if (run == 4 && !(maskBits(cmpge(mul(last, dir), endV)) & live)) {
+            s0 = madd(offset, c1, target);
+            s1 = madd(offset, c2, target);
+            s2 = madd(offset, c3, target);
+            s3 = add(last, target);
+            offset = last;
+            // Rising or falling, the run's peak is at one of its ends
+            peak = max(peak, s3);
+        } else {
+            store(lanes.offset, offset);
+            stepLanes(slots, lanes, samples, run);
+            offset = load(lanes.offset);
+            loadSegments();
+            s0 = load(samples[0]);
+            s1 = run > 1 ? load(samples[1]) : s0;
+            s2 = run > 2 ? load(samples[2]) : s1;
+            s3 = run > 3 ? load(samples[3]) : s2;
+            peak = max(peak, max(max(s0, s1), max(s2, s3)));
+        }
+
+        if (!out) continue;
+        float* o = out + i * kLanes;
+        store(o, s0);
+        if (run > 1) store(o + kLanes, s1);
+        if (run > 2) store(o + kLanes * 2, s2);
+        if (run > 3) store(o + kLanes * 3, s3);
+    }
+
+    store(lanes.offset, offset);
+    alignas(16) float level[kLanes], high[kLanes];
+    store(level, add(target, offset));
+    store(high, peak);
+    for (int l = 0; l < kLanes; ++l) {
+        int v = slots[l];
+        if (v < 0) continue;
+        offsets[v] = lanes.offset[l];
+        levels[v] = level[l];
+        peaks[v] = high[l];
+    }
+}
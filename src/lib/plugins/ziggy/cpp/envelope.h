@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Attack-decay-sustain-release envelopes for a bank of voice slots,
+// generated incrementally. Every segment is an exponential curve heading
+// for a target a little past its end: the distance left is multiplied by a
+// fixed coefficient each sample, so a sample costs one multiply-add, and
+// kLanes voices run in lockstep, one per SIMD lane. The attack rises on a
+// convex curve to 1; decay and release fall exponentially and end exactly
+// after their set times.
+//
+// Settings are latched per voice at note on. A voice that has to go
+// quietly but quickly, such as one dropped when the polyphony is lowered,
+// takes a fast release, the same curve over kFastReleaseSeconds.
+class EnvelopeBank {
+public:
+    static constexpr int kLanes = 4;
+    static constexpr float kFastReleaseSeconds = 0.005f;
+
+    enum Stage : uint8_t { Idle, Attack, Decay, Sustain, Release, FastRelease };
+
+    explicit EnvelopeBank(int voices);
+
+    // Segment times in seconds and the sustain level, used from the next
+    // noteOn
+    void setParameters(int v, float attack, float decay, float sustain, float release, float sampleRate);
+
+    // Starts the attack from the current level, so a retriggered voice
+    // doesn't jump
+    void noteOn(int v);
+    void noteOff(int v);
+    void fastRelease(int v);
+    // Ends at once
+    void stop(int v);
+
+    Stage stage(int v) const { return static_cast<Stage>(stages[v]); }
+    bool isActive(int v) const { return stages[v] != Idle; }
+    bool released(int v) const { return stages[v] == Release || stages[v] == FastRelease; }
+    bool attacking(int v) const { return stages[v] == Attack; }
+    // After the last generated sample
+    float level(int v) const { return levels[v]; }
+    // Highest level over the last generated block and the level it
+    // started from
+    float peak(int v) const { return peaks[v]; }
+
+    // Generates frames samples for kLanes slots, -1 for an unused lane,
+    // into out with the lanes interleaved: sample i of lane l at
+    // out[i * kLanes + l]. out may be nullptr when only level and peak are
+    // wanted.
+    void process(const int* slots, float* out, int frames);
+
+private:
+    // Per-voice segment rates, the distance to the target kept each sample
+    struct Shape {
+        float attack = 0.0f;
+        float decay = 0.0f;
+        float sustain = 1.0f;
+        float release = 0.0f;
+        float fast = 0.0f;
+    };
+
+    // The running segments of kLanes voices, gathered for process
+    struct Lanes {
+        alignas(16) float offset[kLanes];
+        alignas(16) float coeff[kLanes];
+        alignas(16) float target[kLanes];
+        alignas(16) float direction[kLanes];
+        alignas(16) float end[kLanes];
+    };
+    void loadLanes(const int* slots, Lanes& lanes) const;
+    // frames (at most 4) samples a lane at a time into out[sample][lane],
+    // moving lanes whose segment ends on to the next
+    void stepLanes(const int* slots, Lanes& lanes, float (*out)[kLanes], int frames);
+
+    void enter(int v, Stage stage);
+    // The running segment reached its end: pins the level there and moves on
+    void finishSegment(int v);
+
+    std::vector<Shape> shapes;
+    std::vector<uint8_t> stages;
+    std::vector<float> levels;
+    std::vector<float> peaks;
+    // The running segment: level = target + offset, and offset *= coeff
+    // each sample. It ends once offset * direction >= end, with direction
+    // +1 rising and -1 falling, at endLevel; held stages never end.
+    std::vector<float> offsets;
+    std::vector<float> coeff;
+    std::vector<float> targets;
+    std::vector<float> direction;
+    std::vector<float> end;
+    std::vector<float> endLevel;
+};
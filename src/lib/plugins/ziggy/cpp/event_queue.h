@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Timestamped control event. Four 32-bit words so JS can write events
+// straight into the WASM heap without going through embind.
+struct EngineEvent {
+    enum Type : uint32_t {
+        NoteOn = 1,    // data: MIDI note, value: velocity
+        NoteOff = 2,   // data: MIDI note
+        SetParam = 3   // data: Param id, value: parameter value
+    };
+
+    uint32_t type;
+    uint32_t frame;  // engine frame the event takes effect at (wraps)
+    int32_t data;
+    float value;
+};
+
+static_assert(sizeof(EngineEvent) == 16, "EngineEvent is shared with JS");
+
+// Lock-free single-producer/single-consumer ring of EngineEvents. The read and
+// write counters are free-running and masked on access; both are plain 32-bit
+// words, so a JS producer can drive them with Atomics (or plain stores when
+// producer and consumer share a thread). Events must be pushed in
+// non-decreasing frame order.
+class EventQueue {
+public:
+    explicit EventQueue(uint32_t minCapacity) {
+        uint32_t capacity = 1;
+        while (capacity < minCapacity) capacity <<= 1;
+        events.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    // Producer side. Returns false when the queue is full.
+    bool push(const EngineEvent& event) {
+        uint32_t write = writeIndex.load(std::memory_order_relaxed);
+        if (write - readIndex.load(std::memory_order_acquire) > mask) return false;
+        events[write & mask] = event;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns the oldest event or nullptr when empty.
+    const EngineEvent* peek() const {
+        uint32_t read = readIndex.load(std::memory_order_relaxed);
+        if (read == writeIndex.load(std::memory_order_acquire)) return nullptr;
+        return &events[read & mask];
+    }
+
+    void pop() {
+        readIndex.store(readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Shared-memory layout for JS producers
+    uintptr_t bufferPtr() const { return reinterpret_cast<uintptr_t>(events.data()); }
+    uintptr_t writeIndexPtr() const { return reinterpret_cast<uintptr_t>(&writeIndex); }
+    uintptr_t readIndexPtr() const { return reinterpret_cast<uintptr_t>(&readIndex); }
+    uint32_t capacity() const { return mask + 1; }
+
+private:
+    std::vector<EngineEvent> events;
+    uint32_t mask = 0;
+    // Separate cache lines so producer and consumer don't false-share
+    alignas(64) std::atomic<uint32_t> writeIndex{0};
+    alignas(64) std::atomic<uint32_t> readIndex{0};
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "queue indices are shared with JS");
@@ -0,0 +1,306 @@
+#pragma once
+
+// Polynomial approximations for the control-rate math in the voice path
+// (pitch, cutoff mapping, filter coefficients, LFO, saturation). Scalar and
+// 4-lane versions share their algorithm and coefficients (Cephes minimax
+// fits), so both give the same results up to rounding; only scalar exp2
+// reads 2^(j/64) from a table instead, which four lanes can't look up
+// cheaply. Polynomials are in Estrin form so they don't wait on one long
+// chain of multiply-adds; ziggy-fastmath-bench fails if a version isn't
+// faster than libm.
+//
+// Error bounds, checked against double-precision libm by ziggy-fastmath-bench
+// over the ranges below (the |x| terms are float rounding of the scaled
+// argument, not the polynomials):
+//
+//   exp2(x)     x in [-126, 126]           relative  2.5e-7
+//   exp(x)      |x| < 87                   relative  2.5e-7 + 6e-8 * |x|
+//   log2(x)     x normal, > 0              absolute  2.5e-7 + 6e-8 * |log2 x|
+//   pow(a, b)   a > 0, |b * log2 a| < 126  relative  2.5e-7 + |b| * 1.8e-7  (4-lane only)
+//   sin/cos(x)  |x| <= 8192                absolute  2.5e-7
+//   tanh(x)     all x                      absolute  2.5e-7, relative 5e-7
+//
+// None of these handle NaN or infinities; exp2 clamps its input, so
+// overflow saturates at 2^126.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "simd.h"
+
+namespace fastmath {
+
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2 = 0.69314718055994531f;
+
+namespace detail {
+
+// exp2 on [-0.5, 0.5]: 1 + f * P(f), for the 4-lane exp2
+constexpr float kExp2P0 = 1.535336188319500e-4f;
+constexpr float kExp2P1 = 1.339887440266574e-3f;
+constexpr float kExp2P2 = 9.618437357674640e-3f;
+constexpr float kExp2P3 = 5.550332471162809e-2f;
+constexpr float kExp2P4 = 2.402264791363012e-1f;
+constexpr float kExp2P5 = 6.931472028550421e-1f;
+
+// ln(1 + t) for 1 + t in [sqrt(1/2), sqrt(2)): t - t^2/2 + t^3 * P(t)
+constexpr float kLogP[9] = {
+    7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f,
+    -1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f,
+    2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f,
+};
+
+// sin and cos on [-pi/4, pi/4]
+constexpr float kSin1 = -1.6666654611e-1f;
+constexpr float kSin2 = 8.3321608736e-3f;
+constexpr float kSin3 = -1.9515295891e-4f;
+constexpr float kCos1 = 4.166664568298827e-2f;
+constexpr float kCos2 = -1.388731625493765e-3f;
+constexpr float kCos3 = 2.443315711809948e-5f;
+
+// pi/2 split into three parts for an exact quadrant reduction
+constexpr float kPiOver2A = 1.5703125f;
+constexpr float kPiOver2B = 4.837512969970703125e-4f;
+constexpr float kPiOver2C = 7.54978995489188216e-8f;
+constexpr float kTwoOverPi = 0.63661977236758134f;
+
+// tanh for |x| < 0.625: x + x^3 * P(x^2)
+constexpr float kTanhP0 = -5.70498872745e-3f;
+constexpr float kTanhP1 = 2.06390887954e-2f;
+constexpr float kTanhP2 = -5.37397155531e-2f;
+constexpr float kTanhP3 = 1.33314422036e-1f;
+constexpr float kTanhP4 = -3.33332819422e-1f;
+
+// 2^(j/64), scalar exp2's table; between its entries 2^(f/64) for f in
+// [-0.5, 0.5] is 1 + f * (kExp2T1 + kExp2T2 * f)
+alignas(64) constexpr float kExp2Table[64] = {
+    1.000000000e+00f, 1.010889286e+00f, 1.021897149e+00f, 1.033024879e+00f,
+    1.044273782e+00f, 1.055645178e+00f, 1.067140401e+00f, 1.078760798e+00f,
+    1.090507733e+00f, 1.102382583e+00f, 1.114386743e+00f, 1.126521619e+00f,
+    1.138788635e+00f, 1.151189230e+00f, 1.163724859e+00f, 1.176396992e+00f,
+    1.189207115e+00f, 1.202156731e+00f, 1.215247360e+00f, 1.228480536e+00f,
+    1.241857812e+00f, 1.255380757e+00f, 1.269050957e+00f, 1.282870016e+00f,
+    1.296839555e+00f, 1.310961212e+00f, 1.325236643e+00f, 1.339667524e+00f,
+    1.354255547e+00f, 1.369002423e+00f, 1.383909882e+00f, 1.398979673e+00f,
+    1.414213562e+00f, 1.429613338e+00f, 1.445180807e+00f, 1.460917794e+00f,
+    1.476826146e+00f, 1.492907728e+00f, 1.509164428e+00f, 1.525598151e+00f,
+    1.542210825e+00f, 1.559004400e+00f, 1.575980845e+00f, 1.593142151e+00f,
+    1.610490332e+00f, 1.628027422e+00f, 1.645755478e+00f, 1.663676580e+00f,
+    1.681792831e+00f, 1.700106354e+00f, 1.718619298e+00f, 1.737333835e+00f,
+    1.756252160e+00f, 1.775376493e+00f, 1.794709075e+00f, 1.814252176e+00f,
+    1.834008086e+00f, 1.853979125e+00f, 1.874167634e+00f, 1.894575982e+00f,
+    1.915206561e+00f, 1.936061793e+00f, 1.957144124e+00f, 1.978456026e+00f,
+};
+constexpr float kExp2T1 = 6.931471805599453e-1f / 64.0f;
+constexpr float kExp2T2 = 2.402265069591007e-1f / 4096.0f;
+
+// Adding 1.5 * 2^23 rounds a float of magnitude below 2^22 to the nearest
+// integer, which is then the low bits of the sum's mantissa
+constexpr float kRoundMagic = 12582912.0f;
+constexpr uint32_t kRoundMagicBits = 0x4b400000u;
+
+// Bits of sqrt(1/2): log2 takes mantissas in [sqrt(1/2), sqrt(2)) so the
+// series converges on both sides of 1
+constexpr uint32_t kSqrtHalfBits = 0x3f3504f3u;
+
+inline uint32_t bitsOf(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+inline float fromBits(uint32_t bits) {
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+}
+
+namespace detail {
+
+// 2^(x / 64)
+inline float exp2Sixtyfourths(float x) {
+    x = x < -126.0f * 64.0f ? -126.0f * 64.0f : (x > 126.0f * 64.0f ? 126.0f * 64.0f : x);
+    // m = x rounded, from the low bits of the rounded sum: 2^(m / 64) is a
+    // table entry times 2^(m >> 6)
+    float rounded = x + kRoundMagic;
+    int32_t m = static_cast<int32_t>(bitsOf(rounded) - kRoundMagicBits);
+    float f = x - (rounded - kRoundMagic);
+    float t = kExp2Table[m & 63];
+    // Scaled last, by adding to the exponent, so nothing on the way is
+    // subnormal (which costs a microcode assist per operation)
+    float y = t + t * (f * (kExp2T1 + kExp2T2 * f));
+    return fromBits(bitsOf(y) + (static_cast<uint32_t>(m >> 6) << 23));
+}
+
+}
+
+inline float exp2(float x) { return detail::exp2Sixtyfourths(x * 64.0f); }
+
+inline float exp(float x) { return detail::exp2Sixtyfourths(x * (64.0f * kLog2e)); }
+
+inline float log2(float x) {
+    using namespace detail;
+    // Exponent and mantissa taken relative to sqrt(1/2), centring the
+    // mantissa on 1
+    uint32_t offset = bitsOf(x) - kSqrtHalfBits;
+    int exponent = static_cast<int32_t>(offset) >> 23;
+    float m = fromBits((offset & 0x7fffffu) + kSqrtHalfBits);
+
+    float t = m - 1.0f;
+    float z = t * t;
+    float z2 = z * z;
+    // kLogP[8 - k] is the t^k coefficient
+    float low = (kLogP[7] * t + kLogP[8]) + (kLogP[5] * t + kLogP[6]) * z;
+    float high = (kLogP[3] * t + kLogP[4]) + (kLogP[1] * t + kLogP[2]) * z;
+    float p = low + (high + kLogP[0] * z2) * z2;
+    float ln = t - 0.5f * z + t * z * p;
+    return ln * kLog2e + static_cast<float>(exponent);
+}
+
+inline void sincos(float x, float& s, float& c) {
+    using namespace detail;
+    // Nearest quadrant
+    float rounded = x * kTwoOverPi + kRoundMagic;
+    uint32_t quadrant = bitsOf(rounded);
+    float q = rounded - kRoundMagic;
+    float r = ((x - q * kPiOver2A) - q * kPiOver2B) - q * kPiOver2C;
+    float z = r * r;
+    float z2 = z * z;
+    float sr = r + r * z * ((kSin1 + z * kSin2) + z2 * kSin3);
+    float cr = (1.0f - 0.5f * z) + z2 * ((kCos1 + z * kCos2) + z2 * kCos3);
+
+    // Quadrant mod 4 picks which polynomial and which sign: odd quadrants
+    // swap them, sin is negative in quadrants 2-3 and cos in 1-2
+    float sinAbs = quadrant & 1 ? cr : sr;
+    float cosAbs = quadrant & 1 ? sr : cr;
+    s = quadrant & 2 ? -sinAbs : sinAbs;
+    c = (quadrant + 1) & 2 ? -cosAbs : cosAbs;
+}
+
+inline float sin(float x) {
+    float s, c;
+    sincos(x, s, c);
+    return s;
+}
+
+inline float cos(float x) {
+    float s, c;
+    sincos(x, s, c);
+    return c;
+}
+
+inline float tanh(float x) {
+    using namespace detail;
+    float ax = x < 0.0f ? -x : x;
+    if (ax < 0.625f) {
+        float z = x * x;
+        float p = (((kTanhP0 * z + kTanhP1) * z + kTanhP2) * z + kTanhP3) * z + kTanhP4;
+        return x + x * z * p;
+    }
+    if (ax > 9.0f) return x < 0.0f ? -1.0f : 1.0f;
+    float e = exp2(2.0f * kLog2e * ax);
+    float t = 1.0f - 2.0f / (e + 1.0f);
+    return x < 0.0f ? -t : t;
+}
+
+// 4-lane versions
+
+inline simd::f32x4 exp2(simd::f32x4 x) {
+    using namespace simd;
+    using namespace detail;
+    x = min(max(x, set1(-126.0f)), set1(126.0f));
+    f32x4 rounded = add(x, set1(kRoundMagic));
+    f32x4 f = sub(x, sub(rounded, set1(kRoundMagic)));
+    f32x4 f2 = mul(f, f);
+    f32x4 p = madd(madd(set1(kExp2P0), f, set1(kExp2P1)), f2, madd(set1(kExp2P2), f, set1(kExp2P3)));
+    p = madd(p, f2, madd(set1(kExp2P4), f, set1(kExp2P5)));
+    f32x4 scale = asFloat(shli(addi(asInt(rounded), set1i(127 - static_cast<int32_t>(kRoundMagicBits))), 23));
+    return mul(madd(f, p, set1(1.0f)), scale);
+}
+
+inline simd::f32x4 exp(simd::f32x4 x) { return exp2(simd::mul(x, simd::set1(kLog2e))); }
+
+inline simd::f32x4 log2(simd::f32x4 x) {
+    using namespace simd;
+    using namespace detail;
+    i32x4 offset = addi(asInt(x), set1i(-static_cast<int32_t>(kSqrtHalfBits)));
+    f32x4 exponent = toFloat(srai(offset, 23));
+    f32x4 m = asFloat(addi(andi(offset, set1i(0x7fffff)), set1i(static_cast<int32_t>(kSqrtHalfBits))));
+
+    f32x4 t = sub(m, set1(1.0f));
+    f32x4 z = mul(t, t);
+    f32x4 z2 = mul(z, z);
+    f32x4 low = madd(madd(set1(kLogP[5]), t, set1(kLogP[6])), z, madd(set1(kLogP[7]), t, set1(kLogP[8])));
+    f32x4 high = madd(madd(set1(kLogP[1]), t, set1(kLogP[2])), z, madd(set1(kLogP[3]), t, set1(kLogP[4])));
+    f32x4 p = madd(madd(set1(kLogP[0]), z2, high), z2, low);
+    f32x4 ln = madd(mul(t, z), p, sub(t, mul(z, set1(0.5f))));
+    return madd(ln, set1(kLog2e), exponent);
+}
+
+// a^b for a > 0. 4-lane only: a scalar pow's two chained polynomials are
+// no faster than libm's powf, while four lanes at once are several times
+// faster, e.g. a voice's three glides in one call.
+inline simd::f32x4 pow(simd::f32x4 a, simd::f32x4 b) { return exp2(simd::mul(b, log2(a))); }
+
+inline void sincos(simd::f32x4 x, simd::f32x4& s, simd::f32x4& c) {
+    using namespace simd;
+    using namespace detail;
+    f32x4 q = sub(madd(x, set1(kTwoOverPi), set1(kRoundMagic)), set1(kRoundMagic));
+    f32x4 r = sub(x, mul(q, set1(kPiOver2A)));
+    r = sub(r, mul(q, set1(kPiOver2B)));
+    r = sub(r, mul(q, set1(kPiOver2C)));
+    f32x4 z = mul(r, r);
+    f32x4 z2 = mul(z, z);
+    f32x4 sr = madd(mul(r, z), madd(z2, set1(kSin3), madd(z, set1(kSin2), set1(kSin1))), r);
+    f32x4 cr = madd(z2, madd(z2, set1(kCos3), madd(z, set1(kCos2), set1(kCos1))),
+                    sub(set1(1.0f), mul(z, set1(0.5f))));
+
+    // Odd quadrants swap the polynomials; sin flips sign in quadrants 2-3,
+    // cos in quadrants 1-2
+    f32x4 quadrant = sub(q, mul(set1(4.0f), floor(mul(q, set1(0.25f)))));
+    f32x4 odd = sub(quadrant, mul(set1(2.0f), floor(mul(quadrant, set1(0.5f)))));
+    f32x4 swap = cmpge(odd, set1(0.5f));
+    f32x4 sinNeg = cmpge(quadrant, set1(1.5f));
+    f32x4 cosNeg = bitand_(cmpge(quadrant, set1(0.5f)), cmplt(quadrant, set1(2.5f)));
+    f32x4 sinAbs = select(swap, cr, sr);
+    f32x4 cosAbs = select(swap, sr, cr);
+    const f32x4 zero = set1(0.0f);
+    s = select(sinNeg, sub(zero, sinAbs), sinAbs);
+    c = select(cosNeg, sub(zero, cosAbs), cosAbs);
+}
+
+inline simd::f32x4 sin(simd::f32x4 x) {
+    simd::f32x4 s, c;
+    sincos(x, s, c);
+    return s;
+}
+
+inline simd::f32x4 cos(simd::f32x4 x) {
+    simd::f32x4 s, c;
+    sincos(x, s, c);
+    return c;
+}
+
+inline simd::f32x4 tanh(simd::f32x4 x) {
+    using namespace simd;
+    using namespace detail;
+    const f32x4 zero = set1(0.0f);
+    f32x4 negative = cmplt(x, zero);
+    f32x4 ax = min(select(negative, sub(zero, x), x), set1(9.0f));
+
+    f32x4 z = mul(x, x);
+    f32x4 p = madd(set1(kTanhP0), z, set1(kTanhP1));
+    p = madd(p, z, set1(kTanhP2));
+    p = madd(p, z, set1(kTanhP3));
+    p = madd(p, z, set1(kTanhP4));
+    f32x4 small = madd(mul(x, z), p, x);
+
+    f32x4 e = exp2(mul(ax, set1(2.0f * kLog2e)));
+    f32x4 t = sub(set1(1.0f), div(set1(2.0f), add(e, set1(1.0f))));
+    f32x4 large = select(negative, sub(zero, t), t);
+    return select(cmplt(ax, set1(0.625f)), small, large);
+}
+
+}
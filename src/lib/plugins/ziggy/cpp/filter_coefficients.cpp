@@ -1,5 +1,5 @@
 #include "filter_coefficients.h"
-#include <cmath>
+#include "fast_math.h"
 
 constexpr float TWO_PI = 6.28318530718f;
 
@@ -12,8 +12,8 @@ BiquadCoefficients calculateBiquadCoefficients(
     BiquadCoefficients coeff;
     
     float w0 = TWO_PI * (cutoff / sampleRate);
-    float cosw0 = std::cos(w0);
-    float sinw0 = std::sin(w0);
+    float sinw0, cosw0;
+    fastmath::sincos(w0, sinw0, cosw0);
     float alpha = sinw0 / (2.0f * (1.0f + resonance));
     float a0 = 1.0f + alpha;
 
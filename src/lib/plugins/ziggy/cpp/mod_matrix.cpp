@@ -0,0 +1,46 @@
+#include "mod_matrix.h"
+
+namespace {
+
+// Slot s's source, destination and depth follow Param::Mod1Source
+constexpr int kSlotParams = 3;
+
+Param slotParam(int slot, int field) {
+    return static_cast<Param>(static_cast<int>(Param::Mod1Source) + slot * kSlotParams + field);
+}
+
+}
+
+void ModMatrix::compile(const SynthParams& params) {
+    count = 0;
+    used = 0;
+    add(static_cast<int>(ModSource::Lfo1), static_cast<int>(params[Param::LfoDestination]), params[Param::LfoAmount]);
+    add(static_cast<int>(ModSource::FilterEnvelope), static_cast<int>(ModDestination::Cutoff),
+        params[Param::FilterEnvAmount]);
+    for (int s = 0; s < kSlots; ++s) {
+        add(static_cast<int>(params[slotParam(s, 0)]) - 1, static_cast<int>(params[slotParam(s, 1)]),
+            params[slotParam(s, 2)]);
+    }
+}
+
+bool ModMatrix::routes(Param p) {
+    const int first = static_cast<int>(Param::Mod1Source);
+    const int index = static_cast<int>(p);
+    return p == Param::LfoDestination || p == Param::LfoAmount || p == Param::FilterEnvAmount ||
+           (index >= first && index < first + kSlots * kSlotParams);
+}
+
+void ModMatrix::add(int from, int to, float amount) {
+    if (from < 0 || from >= kModSources || to < 0 || to >= kModDestinations || amount == 0.0f) return;
+    source[count] = static_cast<uint8_t>(from);
+    destination[count] = static_cast<uint8_t>(to);
+    depth[count] = amount;
+    used |= 1u << from;
+    count++;
+}
+
+void ModMatrix::apply(const float* sources, float* destinations) const {
+    for (int r = 0; r < count; ++r) {
+        destinations[destination[r]] += sources[source[r]] * depth[r];
+    }
+}
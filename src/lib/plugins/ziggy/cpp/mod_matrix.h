@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include "params.h"
+
+// What a route reads, once per block. LFOs run -1..1 (LFO 1 after its
+// fade-in), envelopes and velocity 0..1, and Key is the note's distance from
+// middle C in octaves.
+enum class ModSource : uint8_t {
+    Lfo1,
+    Lfo2,
+    AmpEnvelope,
+    FilterEnvelope,
+    Velocity,
+    Key,
+    Count
+};
+
+// What a route moves; Param::LfoDestination takes the first five. Pitch
+// scales every oscillator's frequency by 1 + the sum and Pitch2 only
+// oscillator 2's; Fm scales the FM amount the same way. Cutoff adds to the
+// 0..1 cutoff and Mix to the mix. Phase shifts where oscillators 1 and 2
+// read by the sum in cycles, clamped to -1..1 (kMaxPhaseShift): an offset
+// from their running position, so they come back to it when the sum does.
+enum class ModDestination : uint8_t {
+    Pitch,
+    Cutoff,
+    Fm,
+    Mix,
+    Phase,
+    Pitch2,
+    Count
+};
+
+// Largest Phase shift either way, in cycles
+constexpr float kMaxPhaseShift = 1.0f;
+
+constexpr int kModSources = static_cast<int>(ModSource::Count);
+constexpr int kModDestinations = static_cast<int>(ModDestination::Count);
+
+// A patch's modulation routing compiled to a flat list of multiply-adds:
+// destination += source * depth. compile() runs when the patch changes and
+// drops routes that can't move anything; apply() then costs one
+// multiply-add per live route, with no branches or lookups, whatever the
+// routing. Fixed size, so voices copy it without allocating.
+//
+// Routes come from the patch in this order: LFO 1 to Param::LfoDestination
+// at Param::LfoAmount, the filter envelope to Cutoff at
+// Param::FilterEnvAmount, then the kSlots matrix slots (Param::Mod1Source
+// and on; a source of 0 is off, n is ModSource n - 1).
+class ModMatrix {
+public:
+    static constexpr int kSlots = 4;
+    static constexpr int kMaxRoutes = kSlots + 2;
+
+    void compile(const SynthParams& params);
+    // Whether p is part of the routing, so changing it needs a compile
+    static bool routes(Param p);
+
+    // Adds every route to destinations[kModDestinations], which the caller
+    // starts at their unmodulated values, in route order
+    void apply(const float* sources, float* destinations) const;
+
+    int size() const { return count; }
+    // Whether any route reads source
+    bool reads(ModSource source) const { return (used >> static_cast<int>(source)) & 1; }
+
+private:
+    void add(int source, int destination, float depth);
+
+    uint8_t source[kMaxRoutes] = {};
+    uint8_t destination[kMaxRoutes] = {};
+    float depth[kMaxRoutes] = {};
+    int count = 0;
+    uint32_t used = 0;
+};
@@ -0,0 +1,88 @@
+#include "modulation_cache.h"
+#include <algorithm>
+#include "fast_math.h"
+
+namespace {
+
+constexpr float kTwoPi = 6.28318530718f;
+
+}
+
+float LfoState::advance(float frequency, float waveform, float deltaTime) {
+    phase += frequency * deltaTime;
+    if (phase >= 1.0f) phase -= 1.0f;
+
+    if (waveform < 1.0f) {  // Triangle
+        value = phase < 0.5f ? 4.0f * phase - 1.0f : 3.0f - 4.0f * phase;
+    } else if (waveform < 2.0f) {  // Sawtooth
+        value = 2.0f * phase - 1.0f;
+    } else if (waveform < 3.0f) {  // Square
+        value = phase < 0.5f ? 1.0f : -1.0f;
+    } else if (waveform < 4.0f) {  // Sample and hold, a new value each cycle
+        if (phase < lastPhase) {
+            randomState = randomState * 1664525u + 1013904223u;
+            value = 2.0f * static_cast<float>(randomState >> 8) / 16777215.0f - 1.0f;
+        }
+    } else {  // Sine
+        value = fastmath::sin(kTwoPi * phase);
+    }
+
+    lastPhase = phase;
+    return value;
+}
+
+ModulationCache::ModulationCache(float sampleRate) : sampleRate(sampleRate) {}
+
+void ModulationCache::beginBlock(const SynthParams& params, float deltaTime) {
+    filterCount = 0;
+    glideCount = 0;
+
+    // Free running: 0.1 Hz to 20 Hz
+    float frequency = 0.1f * fastmath::exp2(params[Param::LfoRate] * 7.64385619f);  // 200^rate
+    globalLfo.advance(frequency, params[Param::LfoWaveform], deltaTime);
+    float frequency2 = 0.1f * fastmath::exp2(params[Param::Lfo2Rate] * 7.64385619f);
+    globalLfo2.advance(frequency2, params[Param::Lfo2Waveform], deltaTime);
+}
+
+const BiquadCoefficients& ModulationCache::filter(float cutoff, float resonance, float filterType) {
+    for (int i = 0; i < filterCount; ++i) {
+        const FilterEntry& e = filters[i];
+        if (e.cutoff == cutoff && e.resonance == resonance && e.filterType == filterType) return e.coeffs;
+    }
+    BiquadCoefficients coeffs = calculateBiquadCoefficients(cutoff, sampleRate, resonance, filterType);
+    if (filterCount == kFilterEntries) {
+        uncached = coeffs;
+        return uncached;
+    }
+    filters[filterCount] = {cutoff, resonance, filterType, coeffs};
+    return filters[filterCount++].coeffs;
+}
+
+void glideFrequencies(float freqs[3], const float targets[3], float t) {
+    using namespace simd;
+    const f32x4 from = set(freqs[0], freqs[1], freqs[2], 1.0f);
+    const f32x4 to = set(targets[0], targets[1], targets[2], 1.0f);
+    alignas(16) float result[4];
+    store(result, mul(from, fastmath::pow(div(to, from), set1(t))));
+    for (int k = 0; k < 3; ++k) freqs[k] = result[k];
+}
+
+void ModulationCache::glide(float freqs[3], const float targets[3], float t) {
+    for (int i = 0; i < glideCount; ++i) {
+        const GlideEntry& e = glides[i];
+        if (e.t == t && std::equal(freqs, freqs + 3, e.from) && std::equal(targets, targets + 3, e.targets)) {
+            std::copy(e.result, e.result + 3, freqs);
+            return;
+        }
+    }
+    if (glideCount == kGlideEntries) {
+        glideFrequencies(freqs, targets, t);
+        return;
+    }
+    GlideEntry& e = glides[glideCount++];
+    std::copy(freqs, freqs + 3, e.from);
+    std::copy(targets, targets + 3, e.targets);
+    e.t = t;
+    glideFrequencies(freqs, targets, t);
+    std::copy(freqs, freqs + 3, e.result);
+}
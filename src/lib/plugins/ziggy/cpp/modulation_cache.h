@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include "filter_coefficients.h"
+#include "params.h"
+
+// LFO phase and output, advanced once per block. Used for each voice's own
+// LFO and for the global one.
+struct LfoState {
+    float phase = 0.0f;
+    float value = 0.0f;
+    float lastPhase = 0.0f;
+    uint32_t randomState = 1;  // sample & hold; per LFO so renders stay deterministic
+
+    // Advances frequency * deltaTime cycles and returns the new value in
+    // -1..1; waveform as Param::LfoWaveform
+    float advance(float frequency, float waveform, float deltaTime);
+    void reset() {
+        phase = 0.0f;
+        value = 0.0f;
+        lastPhase = 0.0f;
+    }
+};
+
+// Portamento step for a voice's three oscillators, in place:
+// freqs[k] * (targets[k] / freqs[k])^t, all three with one 4-lane pow
+void glideFrequencies(float freqs[3], const float targets[3], float t);
+
+// Block-rate values voices share, worked out at most once per segment: the
+// global LFOs, biquad coefficient sets keyed on (cutoff, resonance, type)
+// and portamento glide ratios. Voices on the same note with the same patch,
+// such as unison stacks or chords without key tracking, then pay for each
+// only once.
+//
+// Voices look values up in their control pass, which runs on the rendering
+// thread before any voice renders, so the tables need no locking. They
+// have a fixed capacity and never allocate; once full, lookups compute
+// without caching.
+class ModulationCache {
+public:
+    explicit ModulationCache(float sampleRate);
+
+    // Starts a segment of deltaTime seconds: empties the tables and advances
+    // the global LFOs at params' rates and waveforms
+    void beginBlock(const SynthParams& params, float deltaTime);
+
+    // Free-running LFO shared by every voice without sync or retrigger,
+    // before amount and fade-in
+    float lfo() const { return globalLfo.value; }
+    // The same for LFO 2, shared by voices without retrigger
+    float lfo2() const { return globalLfo2.value; }
+
+    // Coefficients for a cutoff in Hz, as calculateBiquadCoefficients
+    const BiquadCoefficients& filter(float cutoff, float resonance, float filterType);
+
+    // glideFrequencies
+    void glide(float freqs[3], const float targets[3], float t);
+
+private:
+    static constexpr int kFilterEntries = 32;
+    static constexpr int kGlideEntries = 64;
+
+    struct FilterEntry {
+        float cutoff, resonance, filterType;
+        BiquadCoefficients coeffs;
+    };
+    struct GlideEntry {
+        float from[3], targets[3], t, result[3];
+    };
+
+    float sampleRate;
+    LfoState globalLfo;
+    LfoState globalLfo2;
+    FilterEntry filters[kFilterEntries];
+    int filterCount = 0;
+    GlideEntry glides[kGlideEntries];
+    int glideCount = 0;
+    BiquadCoefficients uncached = {};
+};
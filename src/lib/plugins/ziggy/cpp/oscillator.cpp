@@ -0,0 +1,427 @@
+#include "oscillator.h"
+#include "simd.h"
+#include <cmath>
+
+using namespace simd;
+
+namespace {
+
+struct TableInfo {
+    const void* data;
+    const void* blendData;
+    f32x4 blend;
+    f32x4 size;
+    f32x4 invSize;
+    f32x4 scale;
+    i32x4 sizeInt;
+    bool loop;
+};
+
+// Fold absolute positions back into [0, size)
+inline f32x4 wrap(f32x4 p, const TableInfo& t) {
+    p = sub(p, mul(floor(mul(p, t.invSize)), t.size));
+    p = add(p, bitand_(cmplt(p, set1(0.0f)), t.size));
+    p = sub(p, bitand_(cmpge(p, t.size), t.size));
+    return p;
+}
+
+// Loads table[index] into s0 and table[index + 1] into s1. Compact samples
+// are fetched as one 32-bit pair per lane and widened in registers; Int16
+// comes back in steps, for the caller to scale.
+template <SampleFormat Format>
+inline void pairAt(const void* table, i32x4 index, f32x4& s0, f32x4& s1) {
+    if constexpr (Format == SampleFormat::Float32) {
+        gatherPairs(static_cast<const float*>(table), index, s0, s1);
+    } else {
+        i32x4 pairs = gatherPairs16(static_cast<const uint16_t*>(table), index);
+        if constexpr (Format == SampleFormat::Int16) {
+            s0 = toFloat(srai(shli(pairs, 16), 16));
+            s1 = toFloat(srai(pairs, 16));
+        } else {
+            s0 = halfToFloat(pairs);
+            s1 = halfToFloat(shri(pairs, 16));
+        }
+    }
+}
+
+// index - back, taken from the end of the table when that is negative. The
+// guard continues the table past its end, so pairs read from there are
+// whole. One-shot tables then weight the wrapped taps by zero (beforeStart).
+inline i32x4 behind(i32x4 index, int back, const TableInfo& t) {
+    i32x4 i = addi(index, set1i(-back));
+    return addi(i, andi(srai(i, 31), t.sizeInt));
+}
+
+// Lanes where the tap back samples behind index falls before the start of
+// the table, i.e. index < back
+inline f32x4 beforeStart(i32x4 index, int back) {
+    return cmplt(toFloat(index), set1(static_cast<float>(back)));
+}
+
+constexpr int kSincTaps = 8;
+constexpr int kSincPhases = 64;
+// Kaiser window shape: trades the passband's flatness at the bottom for
+// accuracy up to about 0.3 of the sample rate
+constexpr double kSincBeta = 5.5;
+
+// Modified Bessel function of the first kind, order 0
+double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= 0.5 * x / k;
+        sum += term * term;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc weights for fractional positions r / kSincPhases,
+// kSincTaps per row, with each row's step to the next alongside for
+// interpolating between phases. Rows are normalized to unity gain at DC.
+struct SincTable {
+    float taps[kSincPhases * kSincTaps];
+    float deltas[kSincPhases * kSincTaps];
+
+    SincTable() {
+        float rows[(kSincPhases + 1) * kSincTaps];
+        const double pi = 3.14159265358979323846;
+        const double half = kSincTaps / 2;
+        for (int r = 0; r <= kSincPhases; ++r) {
+            double sum = 0.0;
+            double row[kSincTaps];
+            for (int k = 0; k < kSincTaps; ++k) {
+                // Tap k sits at index - (kSincTaps / 2 - 1) + k
+                double x = (k - (half - 1)) - static_cast<double>(r) / kSincPhases;
+                double u = x / half;
+                double window = u * u < 1.0 ? besselI0(kSincBeta * std::sqrt(1.0 - u * u)) / besselI0(kSincBeta)
+                                            : 0.0;
+                double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                row[k] = sinc * window;
+                sum += row[k];
+            }
+            for (int k = 0; k < kSincTaps; ++k) rows[r * kSincTaps + k] = static_cast<float>(row[k] / sum);
+        }
+        for (int i = 0; i < kSincPhases * kSincTaps; ++i) {
+            taps[i] = rows[i];
+            deltas[i] = rows[i + kSincTaps] - rows[i];
+        }
+    }
+};
+
+const SincTable kSinc;
+
+// An interpolation tier's read at positions p, p in [0, size]. The weights
+// are worked out once, when it is made, and can then be applied to a level
+// and to the level it crossfades into.
+template <Interpolation Quality>
+struct Kernel;
+
+template <>
+struct Kernel<Interpolation::Linear> {
+    i32x4 index;
+    f32x4 frac;
+
+    Kernel(const TableInfo&, f32x4 p) : index(toInt(p)), frac(sub(p, toFloat(index))) {}
+
+    template <SampleFormat Format>
+    f32x4 read(const void* table) const {
+        f32x4 s0, s1;
+        pairAt<Format>(table, index, s0, s1);
+        return madd(frac, sub(s1, s0), s0);
+    }
+};
+
+// Catmull-Rom through the samples either side of each pair
+template <>
+struct Kernel<Interpolation::Hermite> {
+    i32x4 first;
+    f32x4 frac;
+    // One-shot tables: all ones where y0 is before the start, and silent
+    f32x4 silent;
+
+    Kernel(const TableInfo& t, f32x4 p) {
+        i32x4 index = toInt(p);
+        frac = sub(p, toFloat(index));
+        first = behind(index, 1, t);
+        silent = t.loop ? set1(0.0f) : beforeStart(index, 1);
+    }
+
+    template <SampleFormat Format>
+    f32x4 read(const void* table) const {
+        f32x4 y0, y1, y2, y3;
+        pairAt<Format>(table, first, y0, y1);
+        y0 = select(silent, set1(0.0f), y0);
+        pairAt<Format>(table, addi(first, set1i(2)), y2, y3);
+        f32x4 c1 = mul(set1(0.5f), sub(y2, y0));
+        f32x4 c2 = add(sub(y0, mul(set1(2.5f), y1)), sub(add(y2, y2), mul(set1(0.5f), y3)));
+        f32x4 c3 = madd(set1(1.5f), sub(y1, y2), mul(set1(0.5f), sub(y3, y0)));
+        return madd(madd(madd(c3, frac, c2), frac, c1), frac, y1);
+    }
+};
+
+template <>
+struct Kernel<Interpolation::Sinc> {
+    i32x4 first;
+    f32x4 weight[kSincTaps];
+
+    Kernel(const TableInfo& t, f32x4 p) {
+        i32x4 index = toInt(p);
+        f32x4 phase = mul(sub(p, toFloat(index)), set1(static_cast<float>(kSincPhases)));
+        i32x4 row = toInt(phase);
+        f32x4 between = sub(phase, toFloat(row));
+        i32x4 offset = shli(row, 3);  // * kSincTaps
+        for (int k = 0; k < kSincTaps; k += 2) {
+            f32x4 w0, w1, d0, d1;
+            gatherPairs(kSinc.taps + k, offset, w0, w1);
+            gatherPairs(kSinc.deltas + k, offset, d0, d1);
+            weight[k] = madd(between, d0, w0);
+            weight[k + 1] = madd(between, d1, w1);
+        }
+        first = behind(index, kSincTaps / 2 - 1, t);
+        if (!t.loop) {
+            // One-shot tables are silent before their start: tap k is
+            // kSincTaps / 2 - 1 - k samples behind index
+            for (int k = 0; k < kSincTaps / 2 - 1; ++k) {
+                weight[k] = select(beforeStart(index, kSincTaps / 2 - 1 - k), set1(0.0f), weight[k]);
+            }
+        }
+    }
+
+    template <SampleFormat Format>
+    f32x4 read(const void* table) const {
+        // Even and odd taps summed apart, two chains instead of one
+        f32x4 even = set1(0.0f);
+        f32x4 odd = set1(0.0f);
+        for (int k = 0; k < kSincTaps; k += 2) {
+            f32x4 s0, s1;
+            pairAt<Format>(table, addi(first, set1i(k)), s0, s1);
+            even = madd(s0, weight[k], even);
+            odd = madd(s1, weight[k + 1], odd);
+        }
+        return add(even, odd);
+    }
+};
+
+// How a kernel reads its table: the sample format, whether it crossfades
+// into a second level, and the interpolation tier
+template <SampleFormat Format, bool Blend, Interpolation Quality>
+struct Taps {
+    static f32x4 at(const TableInfo& t, f32x4 p) {
+        const Kernel<Quality> kernel(t, p);
+        f32x4 s = kernel.template read<Format>(t.data);
+        if (Blend) {
+            s = madd(t.blend, sub(kernel.template read<Format>(t.blendData), s), s);
+        }
+        if constexpr (Format == SampleFormat::Int16) s = mul(s, t.scale);
+        return s;
+    }
+};
+
+template <Interpolation Quality, typename Render>
+inline void withFormat(const OscTable& table, Render&& render) {
+    const bool blend = table.blendData != nullptr;
+    switch (table.format) {
+        case SampleFormat::Int16:
+            if (blend) render(Taps<SampleFormat::Int16, true, Quality>());
+            else render(Taps<SampleFormat::Int16, false, Quality>());
+            break;
+        case SampleFormat::Half:
+            if (blend) render(Taps<SampleFormat::Half, true, Quality>());
+            else render(Taps<SampleFormat::Half, false, Quality>());
+            break;
+        default:
+            if (blend) render(Taps<SampleFormat::Float32, true, Quality>());
+            else render(Taps<SampleFormat::Float32, false, Quality>());
+            break;
+    }
+}
+
+// Calls render with the Taps for table. Tables too short for a tier's reach
+// behind its position read linearly.
+template <typename Render>
+inline void withTaps(const OscTable& table, Render&& render) {
+    const Interpolation quality = table.size < kSincTaps ? Interpolation::Linear : table.interpolation;
+    switch (quality) {
+        case Interpolation::Sinc:
+            withFormat<Interpolation::Sinc>(table, render);
+            break;
+        case Interpolation::Hermite:
+            withFormat<Interpolation::Hermite>(table, render);
+            break;
+        default:
+            withFormat<Interpolation::Linear>(table, render);
+            break;
+    }
+}
+
+// Reads four samples at absolute (unwrapped) positions p
+template <typename Tap>
+inline f32x4 readFour(const TableInfo& t, f32x4 p) {
+    if (t.loop) {
+        return Tap::at(t, wrap(p, t));
+    }
+    f32x4 past = cmpge(p, t.size);
+    f32x4 clamped = min(max(p, set1(0.0f)), t.size);
+    return select(past, set1(0.0f), Tap::at(t, clamped));
+}
+
+inline void storePartial(float* out, f32x4 v, int count) {
+    alignas(16) float tmp[4];
+    store(tmp, v);
+    for (int k = 0; k < count; ++k) out[k] = tmp[k];
+}
+
+inline TableInfo makeInfo(const OscTable& table, bool loop) {
+    return {table.data, table.blendData, set1(table.blend), set1(static_cast<float>(table.size)),
+            set1(1.0f / table.size), set1(table.scale), set1i(table.size), loop};
+}
+
+// Position carried into the next block
+inline float finalPosition(float pos, int size, bool loop) {
+    if (loop) {
+        pos -= size * std::floor(pos / size);
+        return pos < size ? pos : 0.0f;
+    }
+    return pos >= size ? static_cast<float>(size) : pos;
+}
+
+inline bool parked(float& pos, int size, bool loop, float* out, int n) {
+    if (loop || pos < size) return false;
+    for (int i = 0; i < n; ++i) out[i] = 0.0f;
+    pos = static_cast<float>(size);
+    return true;
+}
+
+template <typename Tap>
+void renderFixed(const TableInfo& t, float increment, float pos, float* out, int n) {
+    const f32x4 step = set1(4.0f * increment);
+
+    // Positions only depend on the block start, so the wrap is off the
+    // loop-carried dependency chain
+    f32x4 p = add(set1(pos), set(increment, 2.0f * increment, 3.0f * increment, 4.0f * increment));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store(out + i, readFour<Tap>(t, p));
+        p = add(p, step);
+    }
+    if (i < n) storePartial(out + i, readFour<Tap>(t, p), n - i);
+}
+
+// Returns the unwrapped position after the block
+template <typename Tap>
+float renderModulated(const TableInfo& t, float increment, const float* modulator, float fmAmount,
+                      float pos, float* out, int n) {
+    const f32x4 inc = set1(increment);
+    const f32x4 incFm = set1(increment * fmAmount);
+
+    // Per-sample increments are prefix-summed into positions; only the running
+    // offset is carried between groups of four
+    f32x4 offset = set1(pos);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        f32x4 steps = prefixSum(madd(load(modulator + i), incFm, inc));
+        store(out + i, readFour<Tap>(t, add(offset, steps)));
+        offset = add(offset, broadcastLast(steps));
+    }
+    if (i < n) {
+        alignas(16) float incs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; i + k < n; ++k) incs[k] = increment * (1.0f + modulator[i + k] * fmAmount);
+        f32x4 steps = prefixSum(load(incs));
+        storePartial(out + i, readFour<Tap>(t, add(offset, steps)), n - i);
+        offset = add(offset, broadcastLast(steps));
+    }
+    return lane3(offset);
+}
+
+// Sums count copies, advancing each from the shared per-sample steps.
+// positions come back unwrapped.
+template <typename Tap, bool Modulated>
+void renderUnison(const TableInfo& t, float increment, const float* ratios, float* positions, int count,
+                  const float* modulator, float fmAmount, float* out, int n) {
+    f32x4 offset[kMaxUnison];
+    f32x4 ratio[kMaxUnison];
+    for (int k = 0; k < count; ++k) {
+        offset[k] = set1(positions[k]);
+        ratio[k] = set1(ratios[k]);
+    }
+    const f32x4 inc = set1(increment);
+    const f32x4 incFm = set1(increment * fmAmount);
+    const f32x4 fixedSteps = set(increment, 2.0f * increment, 3.0f * increment, 4.0f * increment);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        f32x4 steps = Modulated ? prefixSum(madd(load(modulator + i), incFm, inc)) : fixedSteps;
+        f32x4 last = broadcastLast(steps);
+        f32x4 sum = readFour<Tap>(t, madd(steps, ratio[0], offset[0]));
+        offset[0] = madd(last, ratio[0], offset[0]);
+        for (int k = 1; k < count; ++k) {
+            sum = add(sum, readFour<Tap>(t, madd(steps, ratio[k], offset[k])));
+            offset[k] = madd(last, ratio[k], offset[k]);
+        }
+        store(out + i, sum);
+    }
+    if (i < n) {
+        // Missing lanes step by zero, so the last lane is the tail's total
+        alignas(16) float incs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; i + k < n; ++k) {
+            incs[k] = Modulated ? increment * (1.0f + modulator[i + k] * fmAmount) : increment;
+        }
+        f32x4 steps = prefixSum(load(incs));
+        f32x4 last = broadcastLast(steps);
+        f32x4 sum = set1(0.0f);
+        for (int k = 0; k < count; ++k) {
+            sum = add(sum, readFour<Tap>(t, madd(steps, ratio[k], offset[k])));
+            offset[k] = madd(last, ratio[k], offset[k]);
+        }
+        storePartial(out + i, sum, n - i);
+    }
+    for (int k = 0; k < count; ++k) positions[k] = lane3(offset[k]);
+}
+
+}
+
+void renderWavetable(const OscTable& table, float increment,
+                     float& pos, bool loop, float* out, int n) {
+    if (parked(pos, table.size, loop, out, n)) return;
+
+    const TableInfo t = makeInfo(table, loop);
+    withTaps(table, [&](auto tap) { renderFixed<decltype(tap)>(t, increment, pos, out, n); });
+    pos = finalPosition(pos + increment * n, table.size, loop);
+}
+
+void renderWavetableFM(const OscTable& table, float increment,
+                       const float* modulator, float fmAmount,
+                       float& pos, bool loop, float* out, int n) {
+    if (parked(pos, table.size, loop, out, n)) return;
+
+    const TableInfo t = makeInfo(table, loop);
+    float end = pos;
+    withTaps(table, [&](auto tap) {
+        end = renderModulated<decltype(tap)>(t, increment, modulator, fmAmount, pos, out, n);
+    });
+    pos = finalPosition(end, table.size, loop);
+}
+
+void renderWavetableUnison(const OscTable& table, float increment, const float* ratios,
+                           float* positions, int count, const float* modulator, float fmAmount,
+                           bool loop, float* out, int n) {
+    count = count < 1 ? 1 : count > kMaxUnison ? kMaxUnison : count;
+    if (!loop) {
+        bool allParked = true;
+        for (int k = 0; k < count; ++k) allParked = allParked && positions[k] >= table.size;
+        if (allParked) {
+            for (int k = 0; k < count; ++k) parked(positions[k], table.size, loop, out, n);
+            return;
+        }
+    }
+
+    const TableInfo t = makeInfo(table, loop);
+    withTaps(table, [&](auto tap) {
+        if (modulator) {
+            renderUnison<decltype(tap), true>(t, increment, ratios, positions, count, modulator, fmAmount, out, n);
+        } else {
+            renderUnison<decltype(tap), false>(t, increment, ratios, positions, count, nullptr, 0.0f, out, n);
+        }
+    });
+    for (int k = 0; k < count; ++k) positions[k] = finalPosition(positions[k], table.size, loop);
+}
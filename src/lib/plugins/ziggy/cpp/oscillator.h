@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+// Wrap-around samples every table carries after its last sample
+// (table[size + i] == table[i]), so the kernels never need a modulo. Covers
+// the widest interpolation kernel's reach past its position.
+constexpr int kTableGuard = 8;
+
+// How a table's samples are stored. The compact formats take half the memory
+// and cache of float and are converted in registers as the kernels read them:
+// Int16 as multiples of a per-table scale, Half as IEEE half floats.
+enum class SampleFormat : uint8_t { Float32, Int16, Half };
+
+// How a kernel reads between samples, cheapest first:
+//
+//   Linear   2 taps; dull highs, and images when a table plays slower than
+//            its own rate (samples pitched down)
+//   Hermite  4-point cubic; much of the top end back for about twice the cost
+//   Sinc     8-tap Kaiser-windowed sinc, interpolated between 64 phases;
+//            accurate much further up, for samples worth the cycles
+//
+// Looping tables take taps near their ends cyclically, as the guard does;
+// one-shot tables are silent before their first sample.
+enum class Interpolation : uint8_t { Linear, Hermite, Sinc };
+
+// tier: 0 linear, 1 Hermite, 2 sinc
+inline Interpolation interpolationFor(float tier) {
+    int t = static_cast<int>(tier + 0.5f);
+    return static_cast<Interpolation>(t < 0 ? 0 : t > 2 ? 2 : t);
+}
+
+// What a kernel reads: one table level, optionally crossfaded into the next
+// level up (used while a voice glides between mip levels).
+struct OscTable {
+    const void* data;        // samples in format
+    const void* blendData;   // nullptr when not crossfading
+    float blend;             // weight of blendData
+    int size;                // playable length, excluding the guard
+    SampleFormat format = SampleFormat::Float32;
+    float scale = 1.0f;      // Int16: the value of one step
+    Interpolation interpolation = Interpolation::Linear;
+};
+
+// Block wavetable oscillator. Renders n samples into out, advancing pos by
+// `increment` table samples per output sample (pos is advanced before each
+// read). One-shot tables (loop == false) output silence once pos passes the
+// end and park pos at size.
+void renderWavetable(const OscTable& table, float increment,
+                     float& pos, bool loop, float* out, int n);
+
+// Frequency-modulated variant: sample i advances by
+// increment * (1 + modulator[i] * fmAmount).
+void renderWavetableFM(const OscTable& table, float increment,
+                       const float* modulator, float fmAmount,
+                       float& pos, bool loop, float* out, int n);
+
+// Most copies a unison oscillator stacks
+constexpr int kMaxUnison = 8;
+
+// Unison variant: count copies of the table summed into out, copy k
+// advancing by increment * ratios[k] from its own positions[k]. With a
+// modulator each step is scaled as in renderWavetableFM. Per-sample
+// positions are worked out once per four samples and scaled for each copy.
+void renderWavetableUnison(const OscTable& table, float increment, const float* ratios,
+                           float* positions, int count, const float* modulator, float fmAmount,
+                           bool loop, float* out, int n);
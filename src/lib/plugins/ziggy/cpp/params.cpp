@@ -0,0 +1,37 @@
+#include "params.h"
+#include <cstring>
+
+namespace {
+
+const char* const kParamNames[kNumParams] = {
+#define ZIGGY_PARAM_NAME(id, name, def) name,
+    ZIGGY_PARAMS(ZIGGY_PARAM_NAME)
+#undef ZIGGY_PARAM_NAME
+};
+
+const float kParamDefaults[kNumParams] = {
+#define ZIGGY_PARAM_DEFAULT(id, name, def) def,
+    ZIGGY_PARAMS(ZIGGY_PARAM_DEFAULT)
+#undef ZIGGY_PARAM_DEFAULT
+};
+
+}
+
+SynthParams::SynthParams() {
+    std::memcpy(values, kParamDefaults, sizeof(values));
+}
+
+bool paramFromName(const std::string& name, Param& out) {
+    for (size_t i = 0; i < kNumParams; ++i) {
+        if (name == kParamNames[i]) {
+            out = static_cast<Param>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* paramName(Param p) {
+    size_t i = static_cast<size_t>(p);
+    return i < kNumParams ? kParamNames[i] : "";
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Every property the engine understands: identifier, JS name, default value.
+// The order defines the layout of SynthParams.
+#define ZIGGY_PARAMS(X) \
+    /* Amplitude envelope */ \
+    X(AmpAttack,         "ampAttack",         0.5f) \
+    X(AmpDecay,          "ampDecay",          0.1f) \
+    X(AmpSustain,        "ampSustain",        0.7f) \
+    X(AmpRelease,        "ampRelease",        0.9f) \
+    /* Filter envelope */ \
+    X(FilterAttack,      "filterAttack",      0.1f) \
+    X(FilterDecay,       "filterDecay",       0.1f) \
+    X(FilterSustain,     "filterSustain",     0.7f) \
+    X(FilterRelease,     "filterRelease",     0.1f) \
+    X(FilterEnvAmount,   "filterEnvAmount",   0.5f) \
+    /* Filter */ \
+    X(FilterType,        "filterType",        0.0f) \
+    X(Cutoff,            "cutoff",            1000.0f) \
+    X(Resonance,         "resonance",         0.0f) \
+    X(FilterKeyTracking, "filterKeyTracking", 1.0f) \
+    /* Oscillators */ \
+    X(Wave1,             "wave1",             0.0f) \
+    X(Wave2,             "wave2",             0.0f) \
+    X(Wave3,             "wave3",             0.0f) \
+    X(PhaseOffset1,      "phaseOffset1",      0.0f) \
+    X(PhaseOffset2,      "phaseOffset2",      0.0f) \
+    X(PhaseOffset3,      "phaseOffset3",      0.0f) \
+    X(PhaseMode1,        "phaseMode1",        0.0f) \
+    X(PhaseMode2,        "phaseMode2",        0.0f) \
+    X(PhaseMode3,        "phaseMode3",        0.0f) \
+    X(Oct1,              "oct1",              0.0f) \
+    X(Oct2,              "oct2",              0.0f) \
+    X(Oct3,              "oct3",              0.0f) \
+    X(Semi1,             "semi1",             0.0f) \
+    X(Semi2,             "semi2",             0.0f) \
+    X(Semi3,             "semi3",             0.0f) \
+    X(Cent1,             "cent1",             0.0f) \
+    X(Cent2,             "cent2",             0.0f) \
+    X(Cent3,             "cent3",             0.0f) \
+    X(Tune1,             "tune1",             0.0f) \
+    X(Tune2,             "tune2",             0.0f) \
+    X(Tune3,             "tune3",             0.0f) \
+    X(Loop1,             "loop1",             1.0f) \
+    X(Loop2,             "loop2",             1.0f) \
+    X(Loop3,             "loop3",             1.0f) \
+    /* Interpolation tier (oscillator.h): 0 linear, 1 Hermite, 2 sinc */ \
+    X(Interp1,           "interp1",           0.0f) \
+    X(Interp2,           "interp2",           0.0f) \
+    X(Interp3,           "interp3",           0.0f) \
+    X(Unison,            "unison",            1.0f) \
+    X(UnisonDetune,      "unisonDetune",      0.2f) \
+    X(FmAmount,          "fmAmount",          0.0f) \
+    X(Mix,               "mix",               0.5f) \
+    X(Wave3Mix,          "wave3Mix",          0.0f) \
+    X(Osc2Enabled,       "osc2Enabled",       1.0f) \
+    X(Osc3Enabled,       "osc3Enabled",       0.0f) \
+    X(Wave3Decay,        "wave3Decay",        0.1f) \
+    X(Wave3Level,        "wave3Level",        0.0f) \
+    /* LFO */ \
+    X(LfoSync,           "lfoSync",           0.0f) \
+    X(LfoRate,           "lfoRate",           0.5f) \
+    X(LfoAmount,         "lfoAmount",         0.0f) \
+    X(LfoWaveform,       "lfoWaveform",       0.0f) \
+    X(LfoDestination,    "lfoDestination",    0.0f) \
+    X(LfoRetrigger,      "lfoRetrigger",      0.0f) \
+    X(LfoFadeIn,         "lfoFadeIn",         0.0f) \
+    X(Lfo2Rate,          "lfo2Rate",          0.3f) \
+    X(Lfo2Waveform,      "lfo2Waveform",      4.0f) \
+    X(Lfo2Retrigger,     "lfo2Retrigger",     0.0f) \
+    /* Modulation matrix slots (mod_matrix.h): source, destination, depth */ \
+    X(Mod1Source,        "mod1Source",        0.0f) \
+    X(Mod1Destination,   "mod1Destination",   0.0f) \
+    X(Mod1Depth,         "mod1Depth",         0.0f) \
+    X(Mod2Source,        "mod2Source",        0.0f) \
+    X(Mod2Destination,   "mod2Destination",   0.0f) \
+    X(Mod2Depth,         "mod2Depth",         0.0f) \
+    X(Mod3Source,        "mod3Source",        0.0f) \
+    X(Mod3Destination,   "mod3Destination",   0.0f) \
+    X(Mod3Depth,         "mod3Depth",         0.0f) \
+    X(Mod4Source,        "mod4Source",        0.0f) \
+    X(Mod4Destination,   "mod4Destination",   0.0f) \
+    X(Mod4Depth,         "mod4Depth",         0.0f) \
+    /* Noise */ \
+    X(NoiseDecay,        "noiseDecay",        0.1f) \
+    X(NoiseColor,        "noiseColor",        1.0f) \
+    X(NoiseLevel,        "noiseLevel",        0.0f) \
+    /* Voice */ \
+    X(Portamento,        "portamento",        0.0f) \
+    X(Distortion,        "distortion",        0.0f) \
+    X(DistortionCharacter, "distortionCharacter", 0.0f) \
+    X(DistortionQuality, "distortionQuality", 1.0f) \
+    /* Global (PolySynth) */ \
+    X(MasterGain,        "masterGain",        1.0f) \
+    X(Polyphony,         "polyphony",         8.0f) \
+    X(AutoPanWidth,      "autoPanWidth",      0.0f) \
+    X(AutoPanRate,       "autoPanRate",       0.5f)
+
+enum class Param : uint16_t {
+#define ZIGGY_PARAM_ENUM(id, name, def) id,
+    ZIGGY_PARAMS(ZIGGY_PARAM_ENUM)
+#undef ZIGGY_PARAM_ENUM
+    Count
+};
+
+constexpr size_t kNumParams = static_cast<size_t>(Param::Count);
+
+// Flat parameter block, one per voice. Indexed by Param so the render path
+// reads a fixed offset instead of doing a string lookup.
+struct alignas(64) SynthParams {
+    SynthParams();
+
+    float operator[](Param p) const { return values[static_cast<size_t>(p)]; }
+    float& operator[](Param p) { return values[static_cast<size_t>(p)]; }
+
+    float values[kNumParams];
+};
+
+// Resolve a JS property name to its Param. Returns false for unknown names.
+// Control-rate only: never call this from the render path.
+bool paramFromName(const std::string& name, Param& out);
+const char* paramName(Param p);
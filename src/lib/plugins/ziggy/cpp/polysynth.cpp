@@ -1,7 +1,18 @@
 #include "polysynth.h"
+#include <algorithm>
+#include <cmath>
+#include "alloc_audit.h"
+#include "denormals.h"
 
-PolySynth::PolySynth(float sampleRate, int maxVoices) 
-    : sampleRate(sampleRate), maxVoices(maxVoices) {
+namespace {
+
+const std::array<TableHandle, 3> kIdleTables = {kNoTable, kNoTable, kNoTable};
+
+}
+
+PolySynth::PolySynth(float sampleRate, int maxVoices, int maxBlockSize, size_t wavetableBytes) 
+    : bank(maxVoices), arena(wavetableBytes), tables(arena), modulation(sampleRate), sampleRate(sampleRate), maxVoices(maxVoices),
+      maxBlockFrames(std::max(maxBlockSize, 1)) {
     // Initialize voices
     
     voices.reserve(maxVoices);
@@ -12,193 +23,398 @@ PolySynth::PolySynth(float sampleRate, int maxVoices)
     for (int i = 0; i < 1024; ++i) {
         sineTable.push_back(std::sin(2.0f * M_PI * i / 1024.0f));
     }
-    loadWavetable(0, sineTable);  // Now uses the mipmap-enabled loadWavetable
+    loadWavetable(0, sineTable);
 
     for (int i = 0; i < maxVoices; ++i) {
-        voices.emplace_back(sampleRate, &wavetables);
-        voices[i].setProperties(properties);  // Apply initial properties to each voice
-        // voices[i].wavetables = &wavetables;  // Set the wavetables pointer for each voice
+        voices.emplace_back(sampleRate, &bank, i);
+        voices[i].setProperties(params);  // Apply initial properties to each voice
+        voices[i].seedRandom(i + 1);
     }
+    
+    voiceBuffers.resize(static_cast<size_t>(maxVoices) * kSubBlockSize);
+    int maxGroups = (maxVoices + VoiceBank::kLanes - 1) / VoiceBank::kLanes;
+    groupBuffers.resize(static_cast<size_t>(maxGroups) * kSubBlockSize * 2);
+    voiceAudible.assign(maxVoices, 0);
+    voiceTables.assign(maxVoices, kIdleTables);
+    waitingTables.assign(maxVoices, 0);
+    waitingKeys.resize(maxVoices);
 
     voiceCounter = 0;  // Initialize counter
 }
 
 void PolySynth::processBuffer(uintptr_t outputPtr, int bufferSize) {
     float* output = reinterpret_cast<float*>(outputPtr);
-    std::fill(output, output + bufferSize * 2, 0.0f);
-    frameCounter++;
-    
-    float monoBuffer[128];  // Assuming max buffer size of 128
+    render(output, output + 1, 2, bufferSize);
+}
+
+void PolySynth::processPlanar(uintptr_t leftPtr, uintptr_t rightPtr, int bufferSize) {
+    render(reinterpret_cast<float*>(leftPtr), reinterpret_cast<float*>(rightPtr), 1, bufferSize);
+}
+
+void PolySynth::processBlocks(uintptr_t leftPtr, uintptr_t rightPtr, int blockSize, int blockCount) {
+    float* left = reinterpret_cast<float*>(leftPtr);
+    float* right = reinterpret_cast<float*>(rightPtr);
+    for (int b = 0; b < blockCount; ++b) {
+        size_t offset = static_cast<size_t>(b) * blockSize;
+        render(left + offset, right + offset, 1, blockSize);
+    }
+}
+
+void PolySynth::render(float* left, float* right, int stride, int bufferSize) {
+    if (bufferSize < 1) return;
+    if (bufferSize > maxBlockFrames) {
+        // Bigger blocks than the host said to expect render in pieces
+        for (int done = 0; done < bufferSize; done += maxBlockFrames) {
+            render(left + done * stride, right + done * stride, stride, std::min(maxBlockFrames, bufferSize - done));
+        }
+        return;
+    }
+    engineCounters.blocks++;
+    // Pool workers set these once at start-up
+    ScopedDenormalFlush flushDenormals;
+    ScopedRealtimeCheck realtime;
     
-    for (auto& voice : voices) {
-        if (voice.isActive) {
-            std::fill(monoBuffer, monoBuffer + bufferSize, 0.0f);
-            voice.processBuffer(monoBuffer, bufferSize);
-            
-            // Apply the voice's fixed panning
-            for (int i = 0; i < bufferSize; i++) {
-                output[i * 2] += monoBuffer[i] * voice.gainLeft;     // Left
-                output[i * 2 + 1] += monoBuffer[i] * voice.gainRight; // Right
+    // Split the block into sub-blocks and at each event's timestamp; late
+    // events apply at once
+    int offset = 0;
+    while (offset < bufferSize) {
+        int end = std::min(bufferSize, offset + kSubBlockSize);
+        while (const EngineEvent* event = eventQueue.peek()) {
+            int32_t due = static_cast<int32_t>(event->frame - frame);
+            if (due > offset) {
+                end = std::min(end, due);
+                break;
             }
+            applyEvent(*event);
+            eventQueue.pop();
         }
+        
+        renderSegment(left + offset * stride, right + offset * stride, stride, end - offset);
+        offset = end;
     }
+    
+    frame += bufferSize;
+}
 
-    float masterGain = properties["masterGain"];
-    for (int i = 0; i < bufferSize * 2; i++) {
-        output[i] *= masterGain;
+void PolySynth::applyEvent(const EngineEvent& event) {
+    switch (event.type) {
+        case EngineEvent::NoteOn:
+            noteOn(event.data, event.value);
+            break;
+        case EngineEvent::NoteOff:
+            noteOff(event.data);
+            break;
+        case EngineEvent::SetParam:
+            if (event.data >= 0 && event.data < static_cast<int32_t>(kNumParams)) {
+                setProperty(static_cast<Param>(event.data), event.value);
+            }
+            break;
     }
 }
 
-// float PolySynth::process() {
-//     float output = 0.0f;
+void PolySynth::renderSegment(float* left, float* right, int stride, int bufferSize) {
+    engineCounters.segments++;
+    // Shared block-rate values, kept running while no voice plays
+    modulation.beginBlock(params, bufferSize / sampleRate);
+    trimVoices();
+    const int activeTotal = bank.activeCount();
+    if (activeTotal == 0) {
+        engineCounters.idleSegments++;
+        for (int i = 0; i < bufferSize; i++) {
+            left[i * stride] = 0.0f;
+            right[i * stride] = 0.0f;
+        }
+        return;
+    }
     
-//     for (int i = 0; i < maxVoices; ++i) {
-//         if (voices[i].isActive) {
-//             output += voices[i].process();        
-//         }
-//     }
+    // Control pass on this thread: envelopes for every active voice, kLanes
+    // at a time, then each voice's coefficients with shared values from the
+    // modulation cache
+    const int* slots = bank.activeSlots();
+    bank.processEnvelopes(slots, activeTotal, bufferSize);
+    for (int k = 0; k < activeTotal; ++k) {
+        int v = slots[k];
+        if (waitingTables[v]) collectWavetables(v);
+        voiceAudible[v] = voices[v].prepare(bufferSize, &modulation);
+        if (!voiceAudible[v]) engineCounters.silentVoiceBlocks++;
+    }
     
-//     // if (activeVoices > 0) {
-//     //     output *= 0.5f;
-//     // }
+    // Groups of kLanes active voices render on the pool (or serially), each
+    // into its own stereo buffer
+    const int groupTotal = (activeTotal + VoiceBank::kLanes - 1) / VoiceBank::kLanes;
+    renderBlockSize = bufferSize;
+    if (pool) {
+        pool->run(&PolySynth::renderGroupJob, this, groupTotal);
+    } else {
+        for (int g = 0; g < groupTotal; ++g) {
+            renderGroupJob(this, g);
+        }
+    }
     
-//     return output;
-// }
-
-void PolySynth::noteOn(int m, float velocity) {
-    int currentPolyphony = static_cast<int>(properties["polyphony"]);
+    engineCounters.voiceBlocks += activeTotal;
     
-    // First find and turn off any existing notes
-    for (int i = 0; i < maxVoices; ++i) {
-        auto& v = voices[i];
-        if (v.midiNote == m && v.isActive) {
-            v.abort();
+    // Deterministic summing stage, always in group order. Group buffers
+    // are interleaved; this is where the output is split into channels.
+    for (int g = 0; g < groupTotal; ++g) {
+        const float* groupBuffer = &groupBuffers[static_cast<size_t>(g) * kSubBlockSize * 2];
+        if (g == 0) {
+            for (int i = 0; i < bufferSize; i++) {
+                left[i * stride] = groupBuffer[i * 2];
+                right[i * stride] = groupBuffer[i * 2 + 1];
+            }
+            continue;
+        }
+        for (int i = 0; i < bufferSize; i++) {
+            left[i * stride] += groupBuffer[i * 2];
+            right[i * stride] += groupBuffer[i * 2 + 1];
         }
     }
 
-    // Count ONLY active voices (excluding aborting ones)
-    int activeCount = 0;
-    for (int i = 0; i < maxVoices; ++i) {
-        if (voices[i].isActive && !voices[i].isAborting) {
-            activeCount++;
+    float masterGain = params[Param::MasterGain];
+    for (int i = 0; i < bufferSize; i++) {
+        left[i * stride] *= masterGain;
+        right[i * stride] *= masterGain;
+    }
+    
+    // Retire voices whose envelope finished. Walking backwards means the
+    // entry swapped into a freed position has already been checked.
+    for (int k = activeTotal - 1; k >= 0; --k) {
+        int v = slots[k];
+        if (voices[v].finished()) {
+            bank.deactivate(v);
+            // Idle voices drop their tables so replaced ones can be reclaimed
+            releaseWavetables(v);
         }
     }
+}
 
-    // If we're at polyphony limit, find oldest voice and steal it
-    if (activeCount >= currentPolyphony) {
-        int oldestVoiceIndex = 0;
-        int oldestStartTime = std::numeric_limits<int>::max();
+void PolySynth::renderGroupJob(void* context, int group) {
+    PolySynth& self = *static_cast<PolySynth*>(context);
+    const int* slots = self.bank.activeSlots();
+    const int first = group * VoiceBank::kLanes;
+    const int count = std::min(VoiceBank::kLanes, self.bank.activeCount() - first);
+    
+    int laneSlots[VoiceBank::kLanes];
+    const float* inputs[VoiceBank::kLanes];
+    for (int l = 0; l < VoiceBank::kLanes; ++l) {
+        laneSlots[l] = -1;
+        inputs[l] = nullptr;
+        if (l >= count) continue;
         
-        for (int i = 0; i < maxVoices; ++i) {
-            auto& v = voices[i];
-            if (v.isActive && !v.isAborting && v.startTime < oldestStartTime) {
-                oldestStartTime = v.startTime;
-                oldestVoiceIndex = i;
-            }
+        int v = slots[first + l];
+        float* monoBuffer = &self.voiceBuffers[static_cast<size_t>(v) * kSubBlockSize];
+        if (self.voiceAudible[v]) {
+            self.voices[v].render(monoBuffer, self.renderBlockSize);
+        } else {
+            std::fill(monoBuffer, monoBuffer + self.renderBlockSize, 0.0f);
         }
-        
-        voices[oldestVoiceIndex].abort();
+        laneSlots[l] = v;
+        inputs[l] = monoBuffer;
     }
+    
+    float* groupBuffer = &self.groupBuffers[static_cast<size_t>(group) * kSubBlockSize * 2];
+    self.bank.processLanes(laneSlots, inputs, self.bank.ampLanes(group), groupBuffer, self.renderBlockSize);
+}
 
-    // Find first available voice
-    for (int i = 0; i < maxVoices; ++i) {
-        auto& v = voices[i];
-        if (!v.isActive && !v.isAborting) {
-            v.setProperties(properties);
-            
-            // Calculate autopan
-            float pan = properties["autoPanWidth"] * std::sin(2.0f * M_PI * properties["autoPanRate"] * voiceCounter/20.f);
-            float angle = (pan + 1.0f) * M_PI / 4.0f;
-            v.gainLeft = std::cos(angle);
-            v.gainRight = std::sin(angle);
-
-            // Calculate appropriate mip levels before note on
-            // float baseFreq = 440.0f * std::pow(2.0f, (m - 69) / 12.0f);
-            
-            // Calculate frequencies for all three oscillators
-            // float freq1 = baseFreq * std::pow(2.0f, 
-            //     (properties["semi1"] + properties["cent1"] / 100.0f + 
-            //      properties["oct1"] * 12.0f) / 12.0f);
-            // float freq2 = baseFreq * std::pow(2.0f, 
-            //     (properties["semi2"] + properties["cent2"] / 100.0f + 
-            //      properties["oct2"] * 12.0f) / 12.0f);
-            // float freq3 = baseFreq * std::pow(2.0f, 
-            //     (properties["semi3"] + properties["cent3"] / 100.0f + 
-            //      properties["oct3"] * 12.0f) / 12.0f);
-            
-            // Select appropriate wavetables
-            float wave1Key = properties["wave1"];
-            float wave2Key = properties["wave2"];
-            float wave3Key = properties["wave3"];
-            
-            if (auto it1 = wavetables.find(wave1Key); it1 != wavetables.end()) {
-                v.setWavetable1(&(it1->second.at(0)));
-            }
-            
-            if (auto it2 = wavetables.find(wave2Key); it2 != wavetables.end()) {
-                v.setWavetable2(&(it2->second.at(0)));
-            }
-            
-            if (auto it3 = wavetables.find(wave3Key); it3 != wavetables.end()) {
-                v.setWavetable3(&(it3->second.at(0)));
-            }
-            
-            v.noteOn(m, velocity, lastMidiNote);
-            v.startTime = voiceCounter++;
-            break;
+void PolySynth::setRenderThreads(int threads) {
+    if (threads <= 1) {
+        pool.reset();
+    } else if (!pool || pool->threads() != threads) {
+        pool.reset();
+        pool = std::make_unique<RenderPool>(threads);
+    }
+}
+
+bool PolySynth::stealsBefore(int a, int b) const {
+    // A voice still in its attack counts at its full velocity
+    bool releasedA = voices[a].released(), releasedB = voices[b].released();
+    if (releasedA != releasedB) return releasedA;
+    float levelA = bank.velocity[a] * (voices[a].attacking() ? 1.0f : bank.ampEnvelope.level(a));
+    float levelB = bank.velocity[b] * (voices[b].attacking() ? 1.0f : bank.ampEnvelope.level(b));
+    if (levelA != levelB) return levelA < levelB;
+    return bank.startTime[a] < bank.startTime[b];
+}
+
+int PolySynth::allocateVoice(int m) {
+    const int* slots = bank.activeSlots();
+    const int activeTotal = bank.activeCount();
+    const int polyphony = std::clamp(static_cast<int>(params[Param::Polyphony]), 1, maxVoices);
+    
+    // One pass over the active voices: a voice already on this note is
+    // retriggered in place, otherwise track the cheapest voice to steal
+    int steal = -1;
+    for (int k = 0; k < activeTotal; ++k) {
+        int v = slots[k];
+        if (bank.note[v] == m) return v;
+        if (steal < 0 || stealsBefore(v, steal)) steal = v;
+    }
+    
+    if (activeTotal < polyphony) return bank.idleSlot();
+    engineCounters.steals++;
+    return steal;
+}
+
+void PolySynth::trimVoices() {
+    const int polyphony = std::clamp(static_cast<int>(params[Param::Polyphony]), 1, maxVoices);
+    const int* slots = bank.activeSlots();
+    const int activeTotal = bank.activeCount();
+    if (activeTotal <= polyphony) return;
+    
+    int held = 0;
+    for (int k = 0; k < activeTotal; ++k) {
+        held += bank.ampEnvelope.stage(slots[k]) != EnvelopeBank::FastRelease;
+    }
+    for (; held > polyphony; --held) {
+        int drop = -1;
+        for (int k = 0; k < activeTotal; ++k) {
+            int v = slots[k];
+            if (bank.ampEnvelope.stage(v) == EnvelopeBank::FastRelease) continue;
+            if (drop < 0 || stealsBefore(v, drop)) drop = v;
         }
+        voices[drop].fastRelease();
     }
+}
+
+void PolySynth::noteOn(int m, float velocity) {
+    ScopedRealtimeCheck realtime;
+    engineCounters.notes++;
+    
+    // Always succeeds: under the polyphony limit there's an idle slot, at
+    // it there's an active voice. A stolen voice restarts straight away,
+    // its envelope attacking from the level it had.
+    const int i = allocateVoice(m);
+    auto& v = voices[i];
+    if (routingChanged) {
+        routing.compile(params);
+        routingChanged = false;
+    }
+    v.setProperties(params, routing);
+    
+    // Calculate autopan
+    float pan = params[Param::AutoPanWidth] * std::sin(2.0f * M_PI * params[Param::AutoPanRate] * voiceCounter/20.f);
+    float angle = (pan + 1.0f) * M_PI / 4.0f;
+    bank.gainLeft[i] = std::cos(angle);
+    bank.gainRight[i] = std::sin(angle);
+    
+    // Select appropriate wavetables
+    float wave1Key = params[Param::Wave1];
+    float wave2Key = params[Param::Wave2];
+    float wave3Key = params[Param::Wave3];
+    
+    assignWavetable(i, 0, wave1Key);
+    assignWavetable(i, 1, wave2Key);
+    assignWavetable(i, 2, wave3Key);
+    
+    v.noteOn(m, velocity, lastMidiNote);
+    bank.activate(i);
+    bank.note[i] = m;
+    bank.startTime[i] = voiceCounter++;
     
     lastMidiNote = m;
 }
 
 void PolySynth::noteOff(int m) {
-    for (int i = 0; i < maxVoices; ++i) {
-        auto& v = voices[i];  // Changed to reference
-        if (v.midiNote == m && v.isActive) {
-            v.noteOff();
+    ScopedRealtimeCheck realtime;
+    const int* slots = bank.activeSlots();
+    for (int k = 0; k < bank.activeCount(); ++k) {
+        if (bank.note[slots[k]] == m) {
+            voices[slots[k]].noteOff();
         }
     }
 }
 
 
-void PolySynth::setProperties(const std::map<std::string, float>& props) {
-    // Update local properties
-    for (const auto& [name, value] : props) {
-        properties[name] = value;
-    }
+int PolySynth::activeVoiceCount() const {
+    return bank.activeCount();
 }
 
-void PolySynth::loadWavetable(float key, const std::vector<float>& table) {
-    // Create base wavetable and mipmaps
-    std::map<int, std::vector<float>> mipLevels;
-    mipLevels[0] = table;  // Original table
-    
-    // Create progressively downsampled versions
-    std::vector<float> currentTable = table;
-    int level = 1;
-    
-    // // Calculate how many mip levels we need for the full MIDI range
-    // // For highest note (MIDI 127, ~12.5kHz), we need enough mip levels
-    // // float highestFreq = 440.0f * std::pow(2.0f, (127 - 69) / 12.0f);  // Frequency of highest MIDI note
-    // // float nyquist = sampleRate * 0.5f;
-    // // int requiredMipLevels = std::ceil(std::log2(highestFreq / (nyquist / table.size()))) + 1;
-    // int maxLevel = 1;// std::max(10, requiredMipLevels);  // Ensure we have enough mip levels
+void PolySynth::setProperty(Param id, float value) {
+    params[id] = value;
+    if (ModMatrix::routes(id)) routingChanged = true;
+}
 
-    // while (currentTable.size() > 4 && level < maxLevel)  {  // Minimum size threshold
-    //     std::vector<float> downsampled;
-    //     downsampled.reserve(currentTable.size() / 2);
-        
-    //     // Simple averaging downsample
-    //     for (size_t i = 0; i < currentTable.size(); i += 2) {
-    //         float avg = (currentTable[i] + currentTable[(i + 1) % currentTable.size()]) * 0.5f;
-    //         downsampled.push_back(avg);
-    //     }
-        
-    //     mipLevels[level] = downsampled;
-    //     currentTable = downsampled;
-    //     level++;
-    // }
+void PolySynth::loadWavetable(float key, const std::vector<float>& table, SampleFormat format) {
+    if (table.empty()) return;
+    if (format != SampleFormat::Float32) {
+        tables.publish(key, tables.allocate(static_cast<int>(table.size()), format), table.data());
+        return;
+    }
     
-    wavetables[key] = mipLevels;
-}
\ No newline at end of file
+    float* samples = beginWavetable(static_cast<int>(table.size()));
+    if (!samples) return;
+    std::copy(table.begin(), table.end(), samples);
+    commitWavetable(key);
+}
+
+float* PolySynth::beginWavetable(int size) {
+    // An uncommitted table from an earlier call is abandoned
+    arena.release(pendingTable);
+    pendingTable = tables.allocate(size);
+    return arena.samples(pendingTable);
+}
+
+void PolySynth::commitWavetable(float key) {
+    if (pendingTable == kNoTable) return;
+    // Builds the band-limited mip levels up front, off the note path
+    tables.publish(key, pendingTable);
+    pendingTable = kNoTable;
+}
+
+void PolySynth::loadEncodedWavetable(float key, std::vector<uint8_t> encoded, SampleFormat format) {
+    tables.load(key, std::move(encoded), format);
+}
+
+void PolySynth::assignWavetable(int v, int n, float key) {
+    TableHandle& held = voiceTables[v][n];
+    waitingTables[v] &= ~(1u << n);
+    TableHandle handle = tables.acquire(key);
+    if (handle == kNoTable) {
+        if (!tables.awaiting(key)) return;
+        // The loader has been asked for it; collectWavetables picks it up
+        arena.release(held);
+        held = kNoTable;
+        setVoiceTable(v, n, nullptr);
+        waitingTables[v] |= 1u << n;
+        waitingKeys[v][n] = key;
+        return;
+    }
+    // Already playing it: the lookup only counted as a use
+    if (handle == held) {
+        arena.release(handle);
+        return;
+    }
+    arena.release(held);
+    held = handle;
+    setVoiceTable(v, n, arena.get(held));
+}
+
+void PolySynth::setVoiceTable(int v, int n, const Wavetable* table) {
+    if (n == 0) voices[v].setWavetable1(table);
+    else if (n == 1) voices[v].setWavetable2(table);
+    else voices[v].setWavetable3(table);
+}
+
+void PolySynth::collectWavetables(int v) {
+    for (int n = 0; n < 3; ++n) {
+        if (!(waitingTables[v] & (1u << n))) continue;
+        const float key = waitingKeys[v][n];
+        TableHandle handle = tables.acquire(key, false);
+        // Files that failed to decode leave the oscillator silent
+        if (handle == kNoTable && tables.awaiting(key)) continue;
+        waitingTables[v] &= ~(1u << n);
+        if (handle == kNoTable) continue;
+        voiceTables[v][n] = handle;
+        voices[v].lateWavetable(n, arena.get(handle));
+    }
+}
+
+void PolySynth::releaseWavetables(int v) {
+    waitingTables[v] = 0;
+    for (TableHandle& held : voiceTables[v]) {
+        arena.release(held);
+        held = kNoTable;
+    }
+    voices[v].setWavetable1(nullptr);
+    voices[v].setWavetable2(nullptr);
+    voices[v].setWavetable3(nullptr);
+}
@@ -1,37 +1,170 @@
 #pragma once
 #include "synth.h"
+#include "params.h"
+#include "wavetable_arena.h"
+#include "wavetable_loader.h"
+#include "render_pool.h"
+#include "event_queue.h"
+#include "modulation_cache.h"
+#include "voice_bank.h"
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <vector>
-#include <map>
+
+// How often the render fast paths fire. Read and reset from the thread
+// that renders.
+struct EngineCounters {
+    uint64_t blocks = 0;             // rendered host blocks
+    uint64_t segments = 0;           // event-split pieces of those blocks
+    uint64_t idleSegments = 0;       // segments with no active voice: output zeroed, nothing else run
+    uint64_t voiceBlocks = 0;        // voice renders
+    uint64_t silentVoiceBlocks = 0;  // voice renders skipped as inaudible
+    uint64_t notes = 0;              // note-ons, every one of which gets a voice
+    uint64_t steals = 0;             // note-ons that took over another note's voice
+};
 
 class PolySynth {
 public:
-    PolySynth(float sampleRate, int maxVoices = 16);
+    static constexpr size_t kDefaultWavetableBytes = 16 << 20;
+
+    // sampleRate is the host's actual rate. maxBlockSize is the most frames
+    // the host means to pass per process call, for sizing its buffers;
+    // bigger blocks still render, in pieces of it. Internally blocks render
+    // in sub-blocks of at most kSubBlockSize frames, so it costs no extra
+    // memory.
+    PolySynth(float sampleRate, int maxVoices = 16, int maxBlockSize = kSubBlockSize,
+              size_t wavetableBytes = kDefaultWavetableBytes);
     
-    // float process();
+    // Renders bufferSize frames (at least 1, otherwise nothing is written)
+    // of interleaved stereo. Drains the event queue while
+    // rendering, applying each event at its exact sample offset.
     void processBuffer(uintptr_t outputPtr, int bufferSize);
+    // Same, into separate left and right channel buffers; a host can pass
+    // its own channel memory with no de-interleave copy
+    void processPlanar(uintptr_t leftPtr, uintptr_t rightPtr, int bufferSize);
+    // blockCount consecutive planar blocks of blockSize frames in one call,
+    // block b at leftPtr/rightPtr + b * blockSize. Equivalent to as many
+    // processPlanar calls, for hosts that can take several quanta at once.
+    void processBlocks(uintptr_t leftPtr, uintptr_t rightPtr, int blockSize, int blockCount);
+    // The process calls, noteOn and noteOff never allocate; Debug builds
+    // check this (alloc_audit.h)
     void noteOn(int midiNote, float velocity);
     void noteOff(int midiNote);
-    // void setProperty(const std::string& name, float value);
-    void setProperties(const std::map<std::string, float>& props);
+    void setProperty(Param id, float value);
+    
+    // Copies table in as key's level 0, stored in format
+    void loadWavetable(float key, const std::vector<float>& table, SampleFormat format = SampleFormat::Float32);
+    
+    // Zero-copy loading: write `size` samples into the returned buffer, then
+    // commit it under key. The engine adopts the buffer as level 0. Returns
+    // nullptr when the wavetable arena is full.
+    float* beginWavetable(int size);
+    // Replacing a key is safe mid-note: sounding voices keep the old table
+    // until they are retriggered, then its storage is reclaimed
+    void commitWavetable(float key);
+    
+    // Registers an encoded file (Ogg/Vorbis or WAV, see audio_decoder.h)
+    // under key. It is decoded on a background worker the first time a note
+    // uses the key: decoding, mip building and publishing never touch the
+    // audio thread, and the note's oscillator stays silent until the table
+    // is in (a block or two). A key already loaded keeps its current table
+    // until the new file's is published. Decoded tables are cached within
+    // the wavetable budget, least recently played evicted first, and never
+    // while a voice plays them. A compact format halves the table's memory,
+    // for long samples.
+    void loadEncodedWavetable(float key, std::vector<uint8_t> encoded,
+                              SampleFormat format = SampleFormat::Float32);
+    // Decodes key's file now instead of at its first note
+    void preloadWavetable(float key) { tables.preload(key); }
+    // Blocks until every queued file is in, e.g. before an offline render
+    void waitForWavetables() { tables.wait(); }
+    int pendingWavetables() const { return tables.pending(); }
+    int failedWavetables() const { return tables.failures(); }
+    // Builds without threads decode requested files here, one per call;
+    // hosts call it after each render. A no-op otherwise.
+    void serviceWavetables() { tables.service(); }
+    // Bytes of decoded tables to keep cached; the arena size by default
+    void setWavetableBudget(size_t bytes) { tables.setBudget(bytes); }
+    WavetableStats wavetableStats() const { return tables.stats(); }
+    
+    const WavetableArena& wavetableArena() const { return arena; }
+    
+    int activeVoiceCount() const;
     
-    void loadWavetable(float key, const std::vector<float>& table);
+    // Render voices on this many threads (including the audio thread).
+    // 1 renders serially; output is bit-identical either way.
+    void setRenderThreads(int threads);
+    int renderThreads() const { return pool ? pool->threads() : 1; }
     
+    int maxBlockSize() const { return maxBlockFrames; }
+    float rate() const { return sampleRate; }
+    
+    const EngineCounters& counters() const { return engineCounters; }
+    void resetCounters() { engineCounters = EngineCounters(); }
+    
+    // Timestamped note/parameter events from the control thread
+    EventQueue& events() { return eventQueue; }
+    uint32_t currentFrame() const { return frame; }
     
 private:
+    void applyEvent(const EngineEvent& event);
+    // Output sample i of each channel goes to left/right[i * stride]: 2 for
+    // interleaved output, 1 for planar
+    void render(float* left, float* right, int stride, int frames);
+    // Renders up to kSubBlockSize frames with the current voice state
+    void renderSegment(float* left, float* right, int stride, int frames);
+
+    // Slot for a new note on midiNote; may be active, to be retriggered
+    int allocateVoice(int midiNote);
+    // Whether active voice a is a better one to steal than b: released
+    // first, then the quietest, then the oldest
+    bool stealsBefore(int a, int b) const;
+    // Fast-releases voices beyond a lowered polyphony limit
+    void trimVoices();
+    // Renders group g: kLanes active voices' sources, then their mix stage
+    static void renderGroupJob(void* context, int group);
+    // Points osc n of voice v at the table loaded under key. Keys with
+    // nothing registered leave it on its last table; a file not decoded yet
+    // leaves it silent, waiting for the table.
+    void assignWavetable(int v, int n, float key);
+    void setVoiceTable(int v, int n, const Wavetable* table);
+    // Picks up tables that voice v waits for, once loaded
+    void collectWavetables(int v);
+    void releaseWavetables(int v);
+    
     
     std::vector<Synth> voices;
-    std::map<std::string, float> properties = {
-        {"masterGain", 1.0f},
-        {"polyphony", 8.0f},  // Default polyphony setting
-        {"autoPanWidth", 0.0f},
-        {"autoPanRate", 0.5f}
-    };
-    std::map<float, std::map<int, std::vector<float>>> wavetables;
+    VoiceBank bank;
+    SynthParams params;
+    // params' modulation routes, compiled at the first note after they change
+    ModMatrix routing;
+    bool routingChanged = true;
+    WavetableArena arena;
+    // Each key holds one reference on its table, each voice one per oscillator
+    WavetableLoader tables;
+    ModulationCache modulation;
+    std::vector<std::array<TableHandle, 3>> voiceTables;
+    // Per slot: a bit for each oscillator waiting for a table, and its key
+    std::vector<uint8_t> waitingTables;
+    std::vector<std::array<float, 3>> waitingKeys;
+    TableHandle pendingTable = kNoTable;
     float sampleRate;
     int maxVoices;
-    int frameCounter = 0;
+    int maxBlockFrames;
+    uint32_t frame = 0;  // Engine time in samples, advanced per block
     int voiceCounter = 0;
     int lastMidiNote = -1;
-    float panPhase = 0.0f;  // Add this for auto-pan
+    
+    // One mono block per voice and one stereo block per group, so groups can
+    // render in any order (or on any thread) and still be summed in order
+    std::vector<float> voiceBuffers;
+    std::vector<float> groupBuffers;
+    std::vector<uint8_t> voiceAudible;  // per slot, from this segment's control pass
+    int renderBlockSize = 0;
+    EngineCounters engineCounters;
+    std::unique_ptr<RenderPool> pool;
+    
+    EventQueue eventQueue{1024};
 
 }; 
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "render_pool.h"
+#include <chrono>
+#include "alloc_audit.h"
+#include "denormals.h"
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define ZIGGY_NO_THREADS 1
+#endif
+
+namespace {
+
+// Spin briefly, then yield, then nap: keeps wake-up latency low while a
+// stream is running without burning a core once the engine goes quiet
+void backoff(int& spins) {
+    if (spins < 64) {
+        ++spins;
+    } else if (spins < 4096) {
+        ++spins;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+}
+
+RenderPool::RenderPool(int threads) {
+#ifndef ZIGGY_NO_THREADS
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+#endif
+}
+
+RenderPool::~RenderPool() {
+    quit.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void RenderPool::run(Job newJob, void* newContext, int newCount) {
+    if (workers.empty() || newCount <= 1 || newCount > 0xffff) {
+        for (int i = 0; i < newCount; ++i) newJob(newContext, i);
+        return;
+    }
+
+    job.store(newJob, std::memory_order_relaxed);
+    context.store(newContext, std::memory_order_relaxed);
+    completed.store(0, std::memory_order_relaxed);
+
+    uint32_t generation = static_cast<uint32_t>(ticket.load(std::memory_order_relaxed) >> 32) + 1;
+    ticket.store((static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(newCount) << 16),
+                 std::memory_order_release);
+
+    work(generation);
+
+    int spins = 0;
+    while (completed.load(std::memory_order_acquire) < newCount) {
+        if (spins < 64) ++spins; else std::this_thread::yield();
+    }
+}
+
+void RenderPool::work(uint32_t generation) {
+    uint64_t t = ticket.load(std::memory_order_acquire);
+    for (;;) {
+        // A newer generation means this one has been fully handed out
+        if (static_cast<uint32_t>(t >> 32) != generation) return;
+        int index = static_cast<int>(t & 0xffffu);
+        int jobCount = static_cast<int>((t >> 16) & 0xffffu);
+        if (index >= jobCount) return;
+        if (!ticket.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) continue;
+
+        // The generation cannot move on while an index is outstanding, so
+        // these are this generation's values
+        Job currentJob = job.load(std::memory_order_relaxed);
+        void* currentContext = context.load(std::memory_order_relaxed);
+        currentJob(currentContext, index);
+        completed.fetch_add(1, std::memory_order_release);
+        t = ticket.load(std::memory_order_acquire);
+    }
+}
+
+void RenderPool::workerLoop() {
+    // Workers only run render jobs, so these can stay set
+    enableDenormalFlush();
+    enableRealtimeCheck();
+    uint32_t seen = 0;
+    int spins = 0;
+    while (!quit.load(std::memory_order_acquire)) {
+        uint32_t generation = static_cast<uint32_t>(ticket.load(std::memory_order_acquire) >> 32);
+        if (generation != seen) {
+            seen = generation;
+            spins = 0;
+            work(generation);
+        } else {
+            backoff(spins);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads that share out indexed jobs with the calling
+// thread. Workers are created up front; run() neither allocates nor locks, it
+// hands out indices through an atomic ticket and waits on a completion count.
+//
+// Builds without thread support (plain emcc) get a pool with no workers and
+// run() degrades to a serial loop.
+class RenderPool {
+public:
+    using Job = void (*)(void* context, int index);
+
+    // threads counts the calling thread, so 1 means no workers
+    explicit RenderPool(int threads);
+    ~RenderPool();
+
+    RenderPool(const RenderPool&) = delete;
+    RenderPool& operator=(const RenderPool&) = delete;
+
+    int threads() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Runs job(context, i) for every i in [0, count) and returns once all are done
+    void run(Job job, void* context, int count);
+
+private:
+    void workerLoop();
+    // Claims and runs indices of the given generation until none are left
+    void work(uint32_t generation);
+
+    std::vector<std::thread> workers;
+
+    // Bits 32-63: generation, 16-31: job count, 0-15: next index to hand out.
+    // Keeping the count in the same word means a claim can never pair one
+    // generation's index with another generation's bound.
+    std::atomic<uint64_t> ticket{0};
+    std::atomic<int> completed{0};
+    std::atomic<Job> job{nullptr};
+    std::atomic<void*> context{nullptr};
+    std::atomic<bool> quit{false};
+};
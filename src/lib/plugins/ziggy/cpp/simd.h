@@ -0,0 +1,343 @@
+#pragma once
+
+// Minimal 4-lane float/int vector layer used by the DSP kernels.
+// SSE2 (plus SSE4.1/AVX2/FMA when enabled) natively, SIMD128 under emcc
+// with -msimd128, and a scalar fallback everywhere else.
+
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+#if defined(__wasm_simd128__)
+    #include <wasm_simd128.h>
+    #define ZIGGY_SIMD_WASM 1
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define ZIGGY_SIMD_SSE 1
+#else
+    #define ZIGGY_SIMD_SCALAR 1
+#endif
+
+namespace simd {
+
+#if ZIGGY_SIMD_SSE
+
+struct f32x4 { __m128 v; };
+struct i32x4 { __m128i v; };
+
+inline f32x4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+inline void store(float* p, f32x4 a) { _mm_storeu_ps(p, a.v); }
+inline f32x4 set1(float x) { return {_mm_set1_ps(x)}; }
+inline f32x4 set(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+inline f32x4 add(f32x4 a, f32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline f32x4 sub(f32x4 a, f32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline f32x4 mul(f32x4 a, f32x4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline f32x4 div(f32x4 a, f32x4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline f32x4 min(f32x4 a, f32x4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline f32x4 max(f32x4 a, f32x4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline f32x4 cmpge(f32x4 a, f32x4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline f32x4 cmplt(f32x4 a, f32x4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+// mask ? a : b, mask lanes all-ones or all-zeros
+inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+    return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+inline f32x4 bitand_(f32x4 a, f32x4 b) { return {_mm_and_ps(a.v, b.v)}; }
+
+// a * b + c
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) {
+#if defined(__FMA__)
+    return {_mm_fmadd_ps(a.v, b.v, c.v)};
+#else
+    return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)};
+#endif
+}
+
+inline f32x4 floor(f32x4 a) {
+#if defined(__SSE4_1__)
+    return {_mm_floor_ps(a.v)};
+#else
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return {_mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)))};
+#endif
+}
+
+// Truncating conversion, inputs must be non-negative
+inline i32x4 toInt(f32x4 a) { return {_mm_cvttps_epi32(a.v)}; }
+inline f32x4 toFloat(i32x4 a) { return {_mm_cvtepi32_ps(a.v)}; }
+inline i32x4 set1i(int32_t x) { return {_mm_set1_epi32(x)}; }
+inline i32x4 addi(i32x4 a, i32x4 b) { return {_mm_add_epi32(a.v, b.v)}; }
+// 2^n for integer n in [-126, 127], built directly in the exponent bits
+inline f32x4 pow2i(i32x4 n) {
+    return {_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n.v, _mm_set1_epi32(127)), 23))};
+}
+// Bit casts and integer bit ops, for taking floats apart
+inline i32x4 asInt(f32x4 a) { return {_mm_castps_si128(a.v)}; }
+inline f32x4 asFloat(i32x4 a) { return {_mm_castsi128_ps(a.v)}; }
+inline i32x4 andi(i32x4 a, i32x4 b) { return {_mm_and_si128(a.v, b.v)}; }
+inline i32x4 ori(i32x4 a, i32x4 b) { return {_mm_or_si128(a.v, b.v)}; }
+// Logical shift right
+inline i32x4 shri(i32x4 a, int bits) { return {_mm_srli_epi32(a.v, bits)}; }
+inline i32x4 shli(i32x4 a, int bits) { return {_mm_slli_epi32(a.v, bits)}; }
+// Arithmetic: shifts the sign in
+inline i32x4 srai(i32x4 a, int bits) { return {_mm_srai_epi32(a.v, bits)}; }
+
+inline f32x4 gather(const float* base, i32x4 idx) {
+#if defined(__AVX2__)
+    return {_mm_i32gather_ps(base, idx.v, 4)};
+#else
+    alignas(16) int32_t i[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+    return {_mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]])};
+#endif
+}
+
+// Loads base[idx] into s0 and base[idx + 1] into s1
+inline void gatherPairs(const float* base, i32x4 idx, f32x4& s0, f32x4& s1) {
+#if defined(__AVX2__)
+    s0 = {_mm_i32gather_ps(base, idx.v, 4)};
+    s1 = {_mm_i32gather_ps(base + 1, idx.v, 4)};
+#else
+    // Four 64-bit loads of adjacent pairs instead of eight scalar loads
+    alignas(16) int32_t i[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+    __m128 a = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(base + i[0])),
+                            reinterpret_cast<const __m64*>(base + i[1]));
+    __m128 b = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(base + i[2])),
+                            reinterpret_cast<const __m64*>(base + i[3]));
+    s0 = {_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))};
+    s1 = {_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))};
+#endif
+}
+
+// base[idx] in the low and base[idx + 1] in the high half of each lane
+inline i32x4 gatherPairs16(const uint16_t* base, i32x4 idx) {
+#if defined(__AVX2__)
+    return {_mm_i32gather_epi32(reinterpret_cast<const int*>(base), idx.v, 2)};
+#else
+    alignas(16) int32_t i[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+    int32_t p[4];
+    for (int k = 0; k < 4; ++k) std::memcpy(&p[k], base + i[k], 4);
+    return {_mm_setr_epi32(p[0], p[1], p[2], p[3])};
+#endif
+}
+
+// Inclusive prefix sum across lanes: {a, a+b, a+b+c, a+b+c+d}
+inline f32x4 prefixSum(f32x4 a) {
+    __m128 x = a.v;
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+    return {x};
+}
+
+inline f32x4 broadcastLast(f32x4 a) { return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3))}; }
+inline float lane3(f32x4 a) { return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3))); }
+// Bit l set where lane l of a comparison mask is set
+inline int maskBits(f32x4 mask) { return _mm_movemask_ps(mask.v); }
+
+// 4x4 transpose: rows become columns
+inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d) { _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v); }
+
+// {l0, r0, l1, r1} and {l2, r2, l3, r3}
+inline void interleave(f32x4 l, f32x4 r, f32x4& lo, f32x4& hi) {
+    lo = {_mm_unpacklo_ps(l.v, r.v)};
+    hi = {_mm_unpackhi_ps(l.v, r.v)};
+}
+
+#elif ZIGGY_SIMD_WASM
+
+struct f32x4 { v128_t v; };
+struct i32x4 { v128_t v; };
+
+inline f32x4 load(const float* p) { return {wasm_v128_load(p)}; }
+inline void store(float* p, f32x4 a) { wasm_v128_store(p, a.v); }
+inline f32x4 set1(float x) { return {wasm_f32x4_splat(x)}; }
+inline f32x4 set(float a, float b, float c, float d) { return {wasm_f32x4_make(a, b, c, d)}; }
+inline f32x4 add(f32x4 a, f32x4 b) { return {wasm_f32x4_add(a.v, b.v)}; }
+inline f32x4 sub(f32x4 a, f32x4 b) { return {wasm_f32x4_sub(a.v, b.v)}; }
+inline f32x4 mul(f32x4 a, f32x4 b) { return {wasm_f32x4_mul(a.v, b.v)}; }
+inline f32x4 div(f32x4 a, f32x4 b) { return {wasm_f32x4_div(a.v, b.v)}; }
+inline f32x4 min(f32x4 a, f32x4 b) { return {wasm_f32x4_pmin(a.v, b.v)}; }
+inline f32x4 max(f32x4 a, f32x4 b) { return {wasm_f32x4_pmax(a.v, b.v)}; }
+inline f32x4 cmpge(f32x4 a, f32x4 b) { return {wasm_f32x4_ge(a.v, b.v)}; }
+inline f32x4 cmplt(f32x4 a, f32x4 b) { return {wasm_f32x4_lt(a.v, b.v)}; }
+inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) { return {wasm_v128_bitselect(a.v, b.v, mask.v)}; }
+inline f32x4 bitand_(f32x4 a, f32x4 b) { return {wasm_v128_and(a.v, b.v)}; }
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return {wasm_f32x4_add(wasm_f32x4_mul(a.v, b.v), c.v)}; }
+inline f32x4 floor(f32x4 a) { return {wasm_f32x4_floor(a.v)}; }
+inline i32x4 toInt(f32x4 a) { return {wasm_i32x4_trunc_sat_f32x4(a.v)}; }
+inline f32x4 toFloat(i32x4 a) { return {wasm_f32x4_convert_i32x4(a.v)}; }
+inline i32x4 set1i(int32_t x) { return {wasm_i32x4_splat(x)}; }
+inline i32x4 addi(i32x4 a, i32x4 b) { return {wasm_i32x4_add(a.v, b.v)}; }
+inline f32x4 pow2i(i32x4 n) {
+    return {wasm_i32x4_shl(wasm_i32x4_add(n.v, wasm_i32x4_splat(127)), 23)};
+}
+inline i32x4 asInt(f32x4 a) { return {a.v}; }
+inline f32x4 asFloat(i32x4 a) { return {a.v}; }
+inline i32x4 andi(i32x4 a, i32x4 b) { return {wasm_v128_and(a.v, b.v)}; }
+inline i32x4 ori(i32x4 a, i32x4 b) { return {wasm_v128_or(a.v, b.v)}; }
+inline i32x4 shri(i32x4 a, int bits) { return {wasm_u32x4_shr(a.v, bits)}; }
+inline i32x4 shli(i32x4 a, int bits) { return {wasm_i32x4_shl(a.v, bits)}; }
+inline i32x4 srai(i32x4 a, int bits) { return {wasm_i32x4_shr(a.v, bits)}; }
+
+inline f32x4 gather(const float* base, i32x4 idx) {
+    return {wasm_f32x4_make(base[wasm_i32x4_extract_lane(idx.v, 0)],
+                            base[wasm_i32x4_extract_lane(idx.v, 1)],
+                            base[wasm_i32x4_extract_lane(idx.v, 2)],
+                            base[wasm_i32x4_extract_lane(idx.v, 3)])};
+}
+
+inline void gatherPairs(const float* base, i32x4 idx, f32x4& s0, f32x4& s1) {
+    int64_t p[4];
+    std::memcpy(&p[0], base + wasm_i32x4_extract_lane(idx.v, 0), 8);
+    std::memcpy(&p[1], base + wasm_i32x4_extract_lane(idx.v, 1), 8);
+    std::memcpy(&p[2], base + wasm_i32x4_extract_lane(idx.v, 2), 8);
+    std::memcpy(&p[3], base + wasm_i32x4_extract_lane(idx.v, 3), 8);
+    v128_t a = wasm_i64x2_make(p[0], p[1]);
+    v128_t b = wasm_i64x2_make(p[2], p[3]);
+    s0 = {wasm_i32x4_shuffle(a, b, 0, 2, 4, 6)};
+    s1 = {wasm_i32x4_shuffle(a, b, 1, 3, 5, 7)};
+}
+
+inline i32x4 gatherPairs16(const uint16_t* base, i32x4 idx) {
+    int32_t p[4];
+    std::memcpy(&p[0], base + wasm_i32x4_extract_lane(idx.v, 0), 4);
+    std::memcpy(&p[1], base + wasm_i32x4_extract_lane(idx.v, 1), 4);
+    std::memcpy(&p[2], base + wasm_i32x4_extract_lane(idx.v, 2), 4);
+    std::memcpy(&p[3], base + wasm_i32x4_extract_lane(idx.v, 3), 4);
+    return {wasm_i32x4_make(p[0], p[1], p[2], p[3])};
+}
+
+inline f32x4 prefixSum(f32x4 a) {
+    const v128_t zero = wasm_f32x4_splat(0.0f);
+    v128_t x = a.v;
+    x = wasm_f32x4_add(x, wasm_i32x4_shuffle(zero, x, 0, 4, 5, 6));
+    x = wasm_f32x4_add(x, wasm_i32x4_shuffle(zero, x, 0, 1, 4, 5));
+    return {x};
+}
+
+inline f32x4 broadcastLast(f32x4 a) { return {wasm_i32x4_shuffle(a.v, a.v, 3, 3, 3, 3)}; }
+inline float lane3(f32x4 a) { return wasm_f32x4_extract_lane(a.v, 3); }
+inline int maskBits(f32x4 mask) { return wasm_i32x4_bitmask(mask.v); }
+
+inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d) {
+    v128_t t0 = wasm_i32x4_shuffle(a.v, b.v, 0, 4, 1, 5);
+    v128_t t1 = wasm_i32x4_shuffle(a.v, b.v, 2, 6, 3, 7);
+    v128_t t2 = wasm_i32x4_shuffle(c.v, d.v, 0, 4, 1, 5);
+    v128_t t3 = wasm_i32x4_shuffle(c.v, d.v, 2, 6, 3, 7);
+    a = {wasm_i32x4_shuffle(t0, t2, 0, 1, 4, 5)};
+    b = {wasm_i32x4_shuffle(t0, t2, 2, 3, 6, 7)};
+    c = {wasm_i32x4_shuffle(t1, t3, 0, 1, 4, 5)};
+    d = {wasm_i32x4_shuffle(t1, t3, 2, 3, 6, 7)};
+}
+
+inline void interleave(f32x4 l, f32x4 r, f32x4& lo, f32x4& hi) {
+    lo = {wasm_i32x4_shuffle(l.v, r.v, 0, 4, 1, 5)};
+    hi = {wasm_i32x4_shuffle(l.v, r.v, 2, 6, 3, 7)};
+}
+
+#else
+
+struct f32x4 { float v[4]; };
+struct i32x4 { int32_t v[4]; };
+
+#define ZIGGY_LANES(expr) { { [&](int i) { return expr; }(0), [&](int i) { return expr; }(1), \
+                              [&](int i) { return expr; }(2), [&](int i) { return expr; }(3) } }
+
+inline f32x4 load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, f32x4 a) { for (int i = 0; i < 4; ++i) p[i] = a.v[i]; }
+inline f32x4 set1(float x) { return {{x, x, x, x}}; }
+inline f32x4 set(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+inline f32x4 add(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] + b.v[i]); }
+inline f32x4 sub(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] - b.v[i]); }
+inline f32x4 mul(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] * b.v[i]); }
+inline f32x4 div(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] / b.v[i]); }
+inline f32x4 min(f32x4 a, f32x4 b) { return ZIGGY_LANES(b.v[i] < a.v[i] ? b.v[i] : a.v[i]); }
+inline f32x4 max(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] < b.v[i] ? b.v[i] : a.v[i]); }
+inline f32x4 cmpge(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] >= b.v[i] ? 1.0f : 0.0f); }
+inline f32x4 cmplt(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] < b.v[i] ? 1.0f : 0.0f); }
+inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) { return ZIGGY_LANES(mask.v[i] != 0.0f ? a.v[i] : b.v[i]); }
+inline f32x4 bitand_(f32x4 a, f32x4 b) { return ZIGGY_LANES(a.v[i] != 0.0f ? b.v[i] : 0.0f); }
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return ZIGGY_LANES(a.v[i] * b.v[i] + c.v[i]); }
+inline f32x4 floor(f32x4 a) { return ZIGGY_LANES(std::floor(a.v[i])); }
+inline i32x4 toInt(f32x4 a) { return {{int32_t(a.v[0]), int32_t(a.v[1]), int32_t(a.v[2]), int32_t(a.v[3])}}; }
+inline f32x4 toFloat(i32x4 a) { return ZIGGY_LANES(float(a.v[i])); }
+inline i32x4 set1i(int32_t x) { return {{x, x, x, x}}; }
+inline i32x4 addi(i32x4 a, i32x4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+inline f32x4 pow2i(i32x4 n) { return ZIGGY_LANES(std::ldexp(1.0f, n.v[i])); }
+inline i32x4 asInt(f32x4 a) {
+    i32x4 r;
+    std::memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+inline f32x4 asFloat(i32x4 a) {
+    f32x4 r;
+    std::memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+inline i32x4 andi(i32x4 a, i32x4 b) { return {{a.v[0] & b.v[0], a.v[1] & b.v[1], a.v[2] & b.v[2], a.v[3] & b.v[3]}}; }
+inline i32x4 ori(i32x4 a, i32x4 b) { return {{a.v[0] | b.v[0], a.v[1] | b.v[1], a.v[2] | b.v[2], a.v[3] | b.v[3]}}; }
+inline i32x4 shri(i32x4 a, int bits) {
+    i32x4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) >> bits);
+    return r;
+}
+inline i32x4 shli(i32x4 a, int bits) {
+    i32x4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) << bits);
+    return r;
+}
+inline i32x4 srai(i32x4 a, int bits) {
+    i32x4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] >> bits;
+    return r;
+}
+inline f32x4 gather(const float* base, i32x4 idx) { return ZIGGY_LANES(base[idx.v[i]]); }
+inline void gatherPairs(const float* base, i32x4 idx, f32x4& s0, f32x4& s1) {
+    s0 = ZIGGY_LANES(base[idx.v[i]]);
+    s1 = ZIGGY_LANES(base[idx.v[i] + 1]);
+}
+
+inline i32x4 gatherPairs16(const uint16_t* base, i32x4 idx) {
+    i32x4 r;
+    for (int i = 0; i < 4; ++i) std::memcpy(&r.v[i], base + idx.v[i], 4);
+    return r;
+}
+
+inline f32x4 prefixSum(f32x4 a) {
+    return {{a.v[0], a.v[0] + a.v[1], a.v[0] + a.v[1] + a.v[2], a.v[0] + a.v[1] + a.v[2] + a.v[3]}};
+}
+
+inline f32x4 broadcastLast(f32x4 a) { return set1(a.v[3]); }
+inline float lane3(f32x4 a) { return a.v[3]; }
+inline int maskBits(f32x4 mask) {
+    return (mask.v[0] != 0.0f) | (mask.v[1] != 0.0f) << 1 | (mask.v[2] != 0.0f) << 2 | (mask.v[3] != 0.0f) << 3;
+}
+
+inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d) {
+    f32x4 r[4] = {a, b, c, d};
+    a = {{r[0].v[0], r[1].v[0], r[2].v[0], r[3].v[0]}};
+    b = {{r[0].v[1], r[1].v[1], r[2].v[1], r[3].v[1]}};
+    c = {{r[0].v[2], r[1].v[2], r[2].v[2], r[3].v[2]}};
+    d = {{r[0].v[3], r[1].v[3], r[2].v[3], r[3].v[3]}};
+}
+
+inline void interleave(f32x4 l, f32x4 r, f32x4& lo, f32x4& hi) {
+    lo = {{l.v[0], r.v[0], l.v[1], r.v[1]}};
+    hi = {{l.v[2], r.v[2], l.v[3], r.v[3]}};
+}
+
+#undef ZIGGY_LANES
+
+#endif
+
+// IEEE half floats in the low 16 bits of each lane. The exponent is rebiased
+// with one multiply, which also normalizes subnormals; infinities and NaNs
+// are not expected.
+inline f32x4 halfToFloat(i32x4 h) {
+    i32x4 sign = shli(andi(h, set1i(0x8000)), 16);
+    f32x4 magnitude = mul(asFloat(shli(andi(h, set1i(0x7fff)), 13)), set1(0x1p112f));
+    return asFloat(ori(asInt(magnitude), sign));
+}
+
+}
@@ -0,0 +1,53 @@
+#include "smoothing.h"
+#include "simd.h"
+
+using namespace simd;
+
+void ParamRamp::fill(float target, float* out, int n) {
+    const float step = (target - current) / n;
+    f32x4 v = add(set1(current), set(step, 2.0f * step, 3.0f * step, 4.0f * step));
+    const f32x4 stride = set1(4.0f * step);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store(out + i, v);
+        v = add(v, stride);
+    }
+    for (; i < n; ++i) out[i] = current + step * (i + 1);
+
+    // Land exactly on the target so a held value stays bit-stable
+    out[n - 1] = target;
+    current = target;
+}
+
+void fillSteps(float from, float to, const float* fm, float* out, int n) {
+    const float step = (to - from) / n;
+    f32x4 v = add(set1(from), set(step, 2.0f * step, 3.0f * step, 4.0f * step));
+    const f32x4 stride = set1(4.0f * step);
+    const f32x4 one = set1(1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store(out + i, sub(fm ? madd(v, load(fm + i), v) : v, one));
+        v = add(v, stride);
+    }
+    for (; i < n; ++i) {
+        const float s = from + step * (i + 1);
+        out[i] = (fm ? s + s * fm[i] : s) - 1.0f;
+    }
+}
+
+void crossfade(float* out, const float* other, const float* amount, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        f32x4 a = load(out + i);
+        store(out + i, madd(sub(load(other + i), a), load(amount + i), a));
+    }
+    for (; i < n; ++i) out[i] += (other[i] - out[i]) * amount[i];
+}
+
+void applyGain(float* out, const float* gain, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store(out + i, mul(load(out + i), load(gain + i)));
+    }
+    for (; i < n; ++i) out[i] *= gain[i];
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Block-rate control values (parameters, LFO, envelopes) spread over the block
+// so modulation moves every sample instead of stepping once per block.
+
+// Linear ramp from the previous block's target to the current one
+class ParamRamp {
+public:
+    // Jumps to value: the next fill() starts there instead of ramping
+    void reset(float value) { current = value; }
+    float value() const { return current; }
+
+    // Writes n samples ending exactly on target
+    void fill(float target, float* out, int n);
+
+private:
+    float current = 0.0f;
+};
+
+// Oscillator steps moving linearly from `from` to `to` table samples per
+// sample, as a modulator for the FM kernels at increment and FM amount 1:
+// sample i steps 1 + out[i]. With fm each step is also scaled by 1 + fm[i];
+// fm may be out.
+void fillSteps(float from, float to, const float* fm, float* out, int n);
+
+// out[i] += (other[i] - out[i]) * amount[i]
+void crossfade(float* out, const float* other, const float* amount, int n);
+
+// out[i] *= gain[i]
+void applyGain(float* out, const float* gain, int n);
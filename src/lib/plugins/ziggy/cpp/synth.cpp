@@ -1,30 +1,56 @@
 #include "synth.h"
 #include <cmath>
+#include "fast_math.h"
 #include "filter_coefficients.h"
+#include "modulation_cache.h"
+#include "oscillator.h"
 
-constexpr float TWO_PI = 6.28318530718f;
-
-Synth::Synth(float sampleRate, std::map<float, std::map<int, std::vector<float>>>* wavetables) 
-    : sampleRate(sampleRate) {
+Synth::Synth(float sampleRate, VoiceBank* bank, int slot)
+    : ownBank(bank ? nullptr : new VoiceBank(1)), bank(bank ? bank : ownBank.get()),
+      slot(bank ? slot : 0), sampleRate(sampleRate), cutoffOctaves(std::log2(sampleRate / 160.0f)),
+      pitchScale(kTableRate / sampleRate) {
     
-    oscillatorOutput.resize(128);  // Pre-allocate the buffer
+    oscScratch.resize(kSubBlockSize);
+    rampBuffer.resize(kSubBlockSize);
+}
 
-    properties["filterKeyTracking"] = 1.0f;  // Add default value for key tracking
-    
-    // Initialize frequency variable
+bool Synth::processBuffer(float* buffer, int bufferSize) {
+    bank->processEnvelopes(&slot, 1, bufferSize);
+    if (!prepare(bufferSize, nullptr)) {
+        std::fill(buffer, buffer + bufferSize, 0.0f);
+        return false;
+    }
+    render(buffer, bufferSize);
+    return true;
 }
 
-void Synth::processBuffer(float* buffer, int bufferSize) {
+bool Synth::prepare(int bufferSize, ModulationCache* shared) {
     float deltaTime = bufferSize / sampleRate;
     stateTime += deltaTime;  // Update state time for every buffer
     
+    EnvelopeBank& ampEnv = bank->ampEnvelope;
+    if (ampEnv.peak(slot) * bank->velocity[slot] < kInaudibleLevel) {
+        if (ampEnv.released(slot)) ampEnv.stop(slot);
+        return false;
+    }
+    
+    float& currentFreq1 = bank->frequency[0][slot];
+    float& currentFreq2 = bank->frequency[1][slot];
+    float& currentFreq3 = bank->frequency[2][slot];
+    
     // Update portamento
+    float glide = 1.0f;
     if (portamentoTime > 0.0f) {
         float t = std::min(stateTime / portamentoTime, 1.0f);
+        glide = t;
         // Exponential interpolation for smoother frequency transitions
-        currentFreq1 = currentFreq1 * std::pow(targetFreq1 / currentFreq1, t);
-        currentFreq2 = currentFreq2 * std::pow(targetFreq2 / currentFreq2, t);
-        currentFreq3 = currentFreq3 * std::pow(targetFreq3 / currentFreq3, t);
+        float freqs[3] = {currentFreq1, currentFreq2, currentFreq3};
+        const float targets[3] = {targetFreq1, targetFreq2, targetFreq3};
+        if (shared) shared->glide(freqs, targets, t);
+        else glideFrequencies(freqs, targets, t);
+        currentFreq1 = freqs[0];
+        currentFreq2 = freqs[1];
+        currentFreq3 = freqs[2];
     }
     
     // Use the pre-calculated frequencies
@@ -32,110 +58,192 @@ void Synth::processBuffer(float* buffer, int bufferSize) {
     float freq2 = currentFreq2;
     float freq3 = currentFreq3;
 
-    // Add LFO processing
-    float lfoMod = processLFO(deltaTime);
-    
-    // Get base parameters before modulation
-    float fmAmount = properties["fmAmount"];
-    float mix = properties["mix"];
-    float modulatedCutoff = properties["cutoff"];
+    // Modulation sources for this block
+    float sources[kModSources];
+    sources[static_cast<int>(ModSource::Lfo1)] = processLFO(deltaTime, shared);
+    sources[static_cast<int>(ModSource::Lfo2)] = processLFO2(deltaTime, shared);
+    sources[static_cast<int>(ModSource::AmpEnvelope)] = bank->ampEnvelope.level(slot);
+    sources[static_cast<int>(ModSource::FilterEnvelope)] = bank->filterEnvelope.level(slot);
+    sources[static_cast<int>(ModSource::Velocity)] = bank->velocity[slot];
+    sources[static_cast<int>(ModSource::Key)] = (midiNote - 60) / 12.0f;
     
     // Add keyboard tracking
-    float keyboardTracking = properties["filterKeyTracking"];
+    float keyboardTracking = params[Param::FilterKeyTracking];
     float noteOffset = (midiNote - 69) * keyboardTracking; // A4 (MIDI note 69) is the reference note
-    // Apply keyboard tracking to the linear cutoff parameter first
-    modulatedCutoff = modulatedCutoff + (noteOffset / 120.0f);
-    
-    // Apply LFO based on destination
-    int destination = static_cast<int>(properties["lfoDestination"]);
-    switch(destination) {
-        case 0: // Oscillators (affects both frequencies)
-            freq1 *= (1.0f + lfoMod);
-            freq2 *= (1.0f + lfoMod);
-            freq3 *= (1.0f + lfoMod);
-            break;
-        case 1: // Filter
-            modulatedCutoff += lfoMod;
-            break;
-        case 2: // FM
-            fmAmount += lfoMod * fmAmount;
-            break;
-        case 3: // Mix
-            mix += lfoMod;
-            break;
-    }
-
-    float filterEnvLevel = filterEnv.process(deltaTime);
-    modulatedCutoff += filterEnvLevel * properties["filterEnvAmount"];
+    
+    // Every destination from its unmodulated value, then all routes in one
+    // pass; a destination nothing routes to passes through unchanged
+    float mod[kModDestinations];
+    mod[static_cast<int>(ModDestination::Pitch)] = 1.0f;
+    mod[static_cast<int>(ModDestination::Pitch2)] = 1.0f;
+    // Keyboard tracking applies to the linear cutoff parameter first
+    mod[static_cast<int>(ModDestination::Cutoff)] = params[Param::Cutoff] + (noteOffset / 120.0f);
+    mod[static_cast<int>(ModDestination::Fm)] = 0.0f;
+    mod[static_cast<int>(ModDestination::Mix)] = params[Param::Mix];
+    mod[static_cast<int>(ModDestination::Phase)] = 0.0f;
+    routing.apply(sources, mod);
+    
+    const float pitch = mod[static_cast<int>(ModDestination::Pitch)];
+    freq1 *= pitch;
+    freq2 *= pitch * mod[static_cast<int>(ModDestination::Pitch2)];
+    freq3 *= pitch;
+    float fmAmount = params[Param::FmAmount];
+    fmAmount += mod[static_cast<int>(ModDestination::Fm)] * fmAmount;
+    float mix = mod[static_cast<int>(ModDestination::Mix)];
+    float modulatedCutoff = mod[static_cast<int>(ModDestination::Cutoff)];
+    
+    // Phase modulation at control rate: render moves the offset from the
+    // last block's to this one over the block, so it never jumps
+    const float phase = std::clamp(mod[static_cast<int>(ModDestination::Phase)], -kMaxPhaseShift, kMaxPhaseShift);
+    block.phaseFrom = smoothingPrimed ? phaseShift : phase;
+    block.phaseTo = phase;
+    phaseShift = phase;
     
     mix = std::clamp(mix, 0.0f, 1.0f);
     
-    bool osc2Enabled = properties["osc2Enabled"] > 0.5f;
+    if (!smoothingPrimed) {
+        fmRamp.reset(fmAmount);
+        mixRamp.reset(mix);
+    }
+    
+    updateUnison();
+    
+    // Pitch moves (LFO, routes, glide) ramp over the block rather than
+    // stepping at its start
+    const float freqs[3] = {freq1, freq2, freq3};
+    for (int k = 0; k < 3; ++k) {
+        block.freqFrom[k] = smoothingPrimed ? block.freq[k] : freqs[k];
+        block.freq[k] = freqs[k];
+    }
+    block.glide = glide;
+    block.fmAmount = fmAmount;
+    block.mix = mix;
+    
+    // The bank filters the block along with the other lanes
+    updateFilter(modulatedCutoff, shared);
+    smoothingPrimed = true;
+    return true;
+}
+
+void Synth::render(float* buffer, int bufferSize) {
+    float& pos1 = bank->phase[0][slot];
+    float& pos2 = bank->phase[1][slot];
+    float& pos3 = bank->phase[2][slot];
+    const float freq1 = block.freq[0];
+    const float freq2 = block.freq[1];
+    const float freq3 = block.freq[2];
+    // Whether each oscillator's pitch moved since the last block; if so it
+    // steps per sample from the ramp buffer (fillSteps)
+    const bool glide1 = block.freqFrom[0] != freq1;
+    const bool glide2 = block.freqFrom[1] != freq2;
+    const bool glide3 = block.freqFrom[2] != freq3;
+    const float glide = block.glide;
+    const float fmAmount = block.fmAmount;
+    const float mix = block.mix;
+    
+    bool osc2Enabled = params[Param::Osc2Enabled] > 0.5f;
     
     
     // Process main oscillators - branch based on osc2Enabled
+    float* output = buffer;
+    float* scratch = oscScratch.data();
+    float* ramp = rampBuffer.data();
+    // The Phase offset, in table samples, is added to the positions before
+    // rendering and taken off after; the change over the block rides on the
+    // increment
+    const float phaseFrom = block.phaseFrom;
+    const float phaseTo = block.phaseTo;
+    const float phaseRamp = (phaseTo - phaseFrom) / bufferSize;
     if (osc2Enabled && currentWavetable2 && currentWavetable1) {
-        // Cache wavetable data and size outside the loop
-        const float* wavetable1Data = currentWavetable1->data();
-        int wavetable1Size = currentWavetable1->size();
-        const float* wavetable2Data = currentWavetable2->data();
-        int wavetable2Size = currentWavetable2->size();
+        OscTable table1 = oscTable(*currentWavetable1, 0, glide);
+        OscTable table2 = oscTable(*currentWavetable2, 1, glide);
+        const float size1 = static_cast<float>(table1.size);
+        const float size2 = static_cast<float>(table2.size);
         
-        // Both oscillators enabled
-        for (int i = 0; i < bufferSize; ++i) {
-            // Process osc2 first for FM
-            float osc2 = processOscillator(wavetable2Data, wavetable2Size, freq2, pos2, isLooping2);
-            
-            // Apply FM from osc2 to osc1
-            float modulated_freq1 = freq1 * (1.0f + osc2 * fmAmount);
-            
-            // Process osc1 with modulated frequency
-            float osc1 = processOscillator(wavetable1Data, wavetable1Size, modulated_freq1, pos1, isLooping1);
-            
-            // Mix the oscillators
-            oscillatorOutput[i] = osc1 * (1.0f - mix) + osc2 * mix;
+        // Render osc2 first, it modulates osc1's frequency
+        pos2 += phaseFrom * size2;
+        if (glide2) {
+            fillSteps(block.freqFrom[1] + phaseRamp * size2, freq2 + phaseRamp * size2, nullptr, ramp, bufferSize);
+            renderWavetableFM(table2, 1.0f, ramp, 1.0f, pos2, isLooping2, scratch, bufferSize);
+        } else {
+            renderWavetable(table2, freq2 + phaseRamp * size2, pos2, isLooping2, scratch, bufferSize);
         }
-    } else if (currentWavetable1) {
-        // Cache wavetable data and size outside the loop
-        const float* wavetable1Data = currentWavetable1->data();
-        int wavetable1Size = currentWavetable1->size();
+        pos2 -= phaseTo * size2;
         
+        shiftOsc1(phaseFrom * size1);
+        
+        if (fmAmount != 0.0f || fmRamp.value() != 0.0f) {
+            // Fold the per-sample FM amount into the modulator
+            fmRamp.fill(fmAmount, ramp, bufferSize);
+            applyGain(ramp, scratch, bufferSize);
+            if (glide1) {
+                fillSteps(block.freqFrom[0] + phaseRamp * size1, freq1 + phaseRamp * size1, ramp, ramp, bufferSize);
+                renderOsc1(table1, 1.0f, ramp, pos1, output, bufferSize);
+            } else {
+                renderOsc1(table1, freq1 + phaseRamp * size1, ramp, pos1, output, bufferSize);
+            }
+        } else if (glide1) {
+            fillSteps(block.freqFrom[0] + phaseRamp * size1, freq1 + phaseRamp * size1, nullptr, ramp, bufferSize);
+            renderOsc1(table1, 1.0f, ramp, pos1, output, bufferSize);
+        } else {
+            renderOsc1(table1, freq1 + phaseRamp * size1, nullptr, pos1, output, bufferSize);
+        }
+        shiftOsc1(-phaseTo * size1);
+        
+        // Mix the oscillators
+        mixRamp.fill(mix, ramp, bufferSize);
+        crossfade(output, scratch, ramp, bufferSize);
+    } else if (currentWavetable1) {
         // Only osc1 enabled
-        for (int i = 0; i < bufferSize; ++i) {
-            oscillatorOutput[i] = processOscillator(wavetable1Data, wavetable1Size, freq1, pos1, isLooping1);
+        const OscTable table1 = oscTable(*currentWavetable1, 0, glide);
+        const float size1 = static_cast<float>(table1.size);
+        shiftOsc1(phaseFrom * size1);
+        if (glide1) {
+            fillSteps(block.freqFrom[0] + phaseRamp * size1, freq1 + phaseRamp * size1, nullptr, ramp, bufferSize);
+            renderOsc1(table1, 1.0f, ramp, pos1, output, bufferSize);
+        } else {
+            renderOsc1(table1, freq1 + phaseRamp * size1, nullptr, pos1, output, bufferSize);
         }
+        shiftOsc1(-phaseTo * size1);
     } else {
         // No oscillators enabled
-        for (int i = 0; i < bufferSize; ++i) {
-            oscillatorOutput[i] = 0.0f;
-        }
+        std::fill(output, output + bufferSize, 0.0f);
     }
     
+    if (!(osc2Enabled && currentWavetable2 && currentWavetable1)) {
+        fmRamp.reset(fmAmount);
+        mixRamp.reset(mix);
+    }
     // Process wavetable3 if enabled (replacing noise)
-    float wave3Level = properties["wave3Level"];
-    if (properties["osc3Enabled"] > 0.5f && wave3Level > 0.0f && currentWavetable3 && wave3Playing) {
-        float wave3Decay = properties["wave3Decay"];
+    float wave3Level = params[Param::Wave3Level];
+    if (params[Param::Osc3Enabled] > 0.5f && wave3Level > 0.0f && currentWavetable3 && wave3Playing) {
+        float wave3Decay = params[Param::Wave3Decay];
         
         // Square the parameters for more intuitive control
         wave3Decay *= wave3Decay * wave3Decay * 10.f;
         wave3Level *= wave3Level;
 
         // Calculate current amplitude using exponential decay
-        float currentWave3Amplitude = wave3Decay == 10.f ? 1.f : std::exp(-stateTime / wave3Decay);
+        float currentWave3Amplitude = wave3Decay == 10.f ? 1.f : fastmath::exp(-stateTime / wave3Decay);
         
         // Only process if the envelope hasn't fully decayed
         if (currentWave3Amplitude > 0.001f) {  // Small threshold to avoid processing tiny values
-            // Cache wavetable data and size outside the loop
-            const float* wavetable3Data = currentWavetable3->data();
             int wavetable3Size = currentWavetable3->size();
+            const OscTable table3 = oscTable(*currentWavetable3, 2, glide);
+            if (glide3) {
+                fillSteps(block.freqFrom[2], freq3, nullptr, ramp, bufferSize);
+                renderWavetableFM(table3, 1.0f, ramp, 1.0f, pos3, isLooping3, scratch, bufferSize);
+            } else {
+                renderWavetable(table3, freq3, pos3, isLooping3, scratch, bufferSize);
+            }
             
+            float gain3 = wave3Level * currentWave3Amplitude;
             for (int i = 0; i < bufferSize; ++i) {
-                float osc3 = processOscillator(wavetable3Data, wavetable3Size, freq3, pos3, isLooping3);
-                oscillatorOutput[i] += osc3 * wave3Level * currentWave3Amplitude;
+                output[i] += scratch[i] * gain3;
             }
             
             // If one-shot mode and we've reached the end, mark as not playing
-            if (!isLooping3 && pos3 >= currentWavetable3->size()) {
+            if (!isLooping3 && pos3 >= wavetable3Size) {
                 wave3Playing = false;
             }
         } else {
@@ -144,121 +252,102 @@ void Synth::processBuffer(float* buffer, int bufferSize) {
         }
     }
     
-    processDistortion(oscillatorOutput.data(), bufferSize, properties["distortion"], 0);
-    // Process filter after bitcrusher
-    processFilter(oscillatorOutput.data(), bufferSize, modulatedCutoff);
-    
-    // Apply amplitude envelope
-    float ampEnvLevel = ampEnv.process(deltaTime);
-    float ampEnvIncrement = (ampEnvLevel - lastAmpEnvLevel) / bufferSize;
-    
-    float currentAmpEnv = lastAmpEnvLevel;
-    for (int i = 0; i < bufferSize; ++i) {
-        buffer[i] += oscillatorOutput[i] * currentAmpEnv * velocity;
-        currentAmpEnv += ampEnvIncrement;
+    distortion.process(output, bufferSize, params[Param::Distortion],
+                       Distortion::shapeFor(params[Param::DistortionCharacter]),
+                       Distortion::qualityFor(params[Param::DistortionQuality]));
+}
+
+
+void Synth::renderOsc1(const OscTable& table, float increment, const float* modulator, float& pos,
+                       float* out, int n) {
+    if (unisonCount > 1) {
+        // Copy 0 plays from the bank's phase, the others from their own
+        unisonPos[0] = pos;
+        renderWavetableUnison(table, increment, unisonRatio, unisonPos, unisonCount, modulator, 1.0f,
+                              isLooping1, out, n);
+        pos = unisonPos[0];
+        for (int i = 0; i < n; ++i) out[i] *= unisonGain;
+    } else if (modulator) {
+        renderWavetableFM(table, increment, modulator, 1.0f, pos, isLooping1, out, n);
+    } else {
+        renderWavetable(table, increment, pos, isLooping1, out, n);
     }
-    
-    lastAmpEnvLevel = ampEnvLevel;
-    
-    if(!ampEnv.isActive()) {
-        isActive = false;
-        isAborting = false;  // Clear the aborting flag when voice is completely inactive
+}
+
+void Synth::shiftOsc1(float samples) {
+    bank->phase[0][slot] += samples;
+    for (int k = 1; k < unisonCount; ++k) unisonPos[k] += samples;
+}
+
+void Synth::updateUnison() {
+    int count = std::clamp(static_cast<int>(params[Param::Unison]), 1, kMaxUnison);
+    float detune = params[Param::UnisonDetune];
+    if (count == unisonCount && detune == unisonDetune) return;
+    unisonCount = count;
+    unisonDetune = detune;
+    unisonGain = 1.0f / std::sqrt(static_cast<float>(count));
+    
+    // Evenly spread over +-kUnisonSpreadCents at full detune
+    for (int k = 0; k < count; ++k) {
+        float offset = count > 1 ? 2.0f * k / (count - 1) - 1.0f : 0.0f;
+        unisonRatio[k] = fastmath::exp2(offset * detune * kUnisonSpreadCents / 1200.0f);
     }
 }
 
-void Synth::processFilter(float* input, int numSamples, float cutoff01) {
+void Synth::updateFilter(float cutoff01, ModulationCache* shared) {
     cutoff01 = std::clamp(cutoff01, 0.001f, 0.99f);
 
-    float cutoff = 40.0f * std::pow(sampleRate / (160.0f), cutoff01);
+    // 40 Hz .. sampleRate / 4, exponential in cutoff01
+    float cutoff = 40.0f * fastmath::exp2(cutoff01 * cutoffOctaves);
 
-    float resonance = properties["resonance"];
-    float filterType = properties["filterType"];
+    float resonance = params[Param::Resonance];
+    float filterType = params[Param::FilterType];
     
-    // Update coefficients if needed
+    // Coefficients for the block-end cutoff, recomputed only when it moves
     if (cutoff != lastCutoff || resonance != lastResonance || filterType != lastFilterType) {
-        auto coeffs = calculateBiquadCoefficients(cutoff, sampleRate, resonance, filterType);
-        b0 = coeffs.b0;
-        b1 = coeffs.b1;
-        b2 = coeffs.b2;
-        a1 = coeffs.a1;
-        a2 = coeffs.a2;
+        bool typeChanged = filterType != lastFilterType;
+        targetCoeffs = shared ? shared->filter(cutoff, resonance, filterType)
+                              : calculateBiquadCoefficients(cutoff, sampleRate, resonance, filterType);
         
         lastCutoff = cutoff;
         lastResonance = resonance;
         lastFilterType = filterType;
-    }
-    
-    // Process all samples in-place
-    float x0;
-    for (int i = 0; i < numSamples; ++i) {
-        x0 = input[i];
-        input[i] = b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
         
-        // Update filter state
-        x2 = x1;
-        x1 = x0;
-        y2 = y1;
-        y1 = input[i];
-    }
-
-    // Add second pass for Lowpass 24
-    if (static_cast<int>(filterType) == 0) {  // Lowpass 24
-        // Use second set of state variables for the second pass
-        for (int i = 0; i < numSamples; ++i) {
-            x0 = input[i];
-            input[i] = b0 * x0 + b1 * x1_2 + b2 * x2_2 - a1 * y1_2 - a2 * y2_2;
-            
-            // Update second filter state
-            x2_2 = x1_2;
-            x1_2 = x0;
-            y2_2 = y1_2;
-            y1_2 = input[i];
+        // A new response shape can't be interpolated into; jump to it
+        if (typeChanged) {
+            coeffs = targetCoeffs;
+            // A second stage that comes back starts from rest
+            bank->s1b[slot] = 0.0f;
+            bank->s2b[slot] = 0.0f;
         }
     }
+    if (!smoothingPrimed) coeffs = targetCoeffs;
+    
+    // The bank's lane stage steps from last block's coefficients to these
+    bank->filterFrom[slot] = coeffs;
+    bank->filterTo[slot] = targetCoeffs;
+    bank->filterCascade[slot] = static_cast<int>(filterType) == 0;
+    coeffs = targetCoeffs;
 }
 
-float Synth::processOscillator(const float* wavetableData, int wavetableSize, float freq, float& pos, bool shouldLoop) {
-    // if (!wavetableData || wavetableSize <= 0) return 0.0f;
-    
-    // Calculate playback rate relative to C4 (MIDI note 60)
-    // For C4, we want to play at original speed (1 sample per step)
-    // For other notes, we scale accordingly
-    float playbackRate = freq ; // 261.63 Hz is C4
-    
-    // Update position (no longer using phase)
-    pos += playbackRate;
-    
-    // Handle looping or one-shot behavior
-    if (pos >= wavetableSize) {
-        if (shouldLoop) {
-            // Loop back to the beginning
-            pos -= wavetableSize;
-        } else {
-            // One-shot mode: stay at the end and return 0
-            pos = wavetableSize;
-            return 0.0f;
-        }
-    }
-    
-    // Get integer position and fractional part for interpolation
-    int index1 = static_cast<int>(pos);
-    int index2 = (index1 + 1) % wavetableSize;
-    float frac = pos - index1;
-    
-    // Linear interpolation between samples
-    float sample = wavetableData[index1] + frac * (wavetableData[index2] - wavetableData[index1]);
-    
-    return sample;
+float Synth::mipLevel(int osc, float glide) const {
+    return mipStart[osc] + (mipTarget[osc] - mipStart[osc]) * glide;
+}
+
+OscTable Synth::oscTable(const Wavetable& wavetable, int osc, float glide) const {
+    OscTable table = wavetable.read(mipLevel(osc, glide));
+    table.interpolation = interpolationFor(params[static_cast<Param>(static_cast<int>(Param::Interp1) + osc)]);
+    return table;
 }
 
 float Synth::calculateFrequency(int midiNote, float semi, float cent, float oct, float tune) {
-    // Special case: if tune is -999, return fixed frequency of 261.63 Hz (C4)
+    // Special case: if tune is -999, play the table at its own rate
     if (tune == -999.0f) {
-        return 1.0f;
+        return pitchScale;
     }
     
     // Normal calculation
-    return  std::pow(2.0f, 
+    return pitchScale * fastmath::exp2(
         (midiNote - 24 + semi + 
          cent / 100.0f + 
          oct * 12.0f + 
@@ -267,12 +356,19 @@ float Synth::calculateFrequency(int midiNote, float semi, float cent, float oct,
 
 void Synth::noteOn(int m, float vel, int fromMidiNote) {
     midiNote = m;
-    velocity = vel;
-    isActive = true;
-    isAborting = false;
+    bank->velocity[slot] = vel;
+    smoothingPrimed = false;
+    distortion.reset();
+    
+    float& pos1 = bank->phase[0][slot];
+    float& pos2 = bank->phase[1][slot];
+    float& pos3 = bank->phase[2][slot];
+    float& currentFreq1 = bank->frequency[0][slot];
+    float& currentFreq2 = bank->frequency[1][slot];
+    float& currentFreq3 = bank->frequency[2][slot];
     
     stateTime = 0.0f;
-    portamentoTime = properties["portamento"];
+    portamentoTime = params[Param::Portamento];
     portamentoTime*=portamentoTime*10.f;
     
     
@@ -282,157 +378,176 @@ void Synth::noteOn(int m, float vel, int fromMidiNote) {
     pos3 = 0.0f;
     
     // Set the loop flags based on properties
-    isLooping1 = properties["loop1"] > 0.5f;
-    isLooping2 = properties["loop2"] > 0.5f;
-    isLooping3 = properties["loop3"] > 0.5f;
+    isLooping1 = params[Param::Loop1] > 0.5f;
+    isLooping2 = params[Param::Loop2] > 0.5f;
+    isLooping3 = params[Param::Loop3] > 0.5f;
     
     // Reset LFO phase if retrigger is enabled
-    if (properties["lfoRetrigger"] > 0.5f) {
-        lfoPhase = 0.0f;
-        lfoValue = 0.0f;
-        lastLfoPhase = 0.0f;
+    if (params[Param::LfoRetrigger] > 0.5f) {
+        lfo.reset();
+    }
+    if (params[Param::Lfo2Retrigger] > 0.5f) {
+        lfo2.reset();
     }
     
     // Calculate frequencies using the new helper function
     targetFreq1 = calculateFrequency(midiNote, 
-                                    properties["semi1"], 
-                                    properties["cent1"], 
-                                    properties["oct1"], 
-                                    properties["tune1"]);
+                                    params[Param::Semi1], 
+                                    params[Param::Cent1], 
+                                    params[Param::Oct1], 
+                                    params[Param::Tune1]);
     
     targetFreq2 = calculateFrequency(midiNote, 
-                                    properties["semi2"], 
-                                    properties["cent2"], 
-                                    properties["oct2"], 
-                                    properties["tune2"]);
+                                    params[Param::Semi2], 
+                                    params[Param::Cent2], 
+                                    params[Param::Oct2], 
+                                    params[Param::Tune2]);
     
     targetFreq3 = calculateFrequency(midiNote, 
-                                    properties["semi3"], 
-                                    properties["cent3"], 
-                                    properties["oct3"], 
-                                    properties["tune3"]);
+                                    params[Param::Semi3], 
+                                    params[Param::Cent3], 
+                                    params[Param::Oct3], 
+                                    params[Param::Tune3]);
     
     if (fromMidiNote >= 0 && portamentoTime > 0.0f) {
         // Set starting frequencies from the previous note
         currentFreq1 = calculateFrequency(fromMidiNote, 
-                                         properties["semi1"], 
-                                         properties["cent1"], 
-                                         properties["oct1"], 
-                                         properties["tune1"]);
+                                         params[Param::Semi1], 
+                                         params[Param::Cent1], 
+                                         params[Param::Oct1], 
+                                         params[Param::Tune1]);
         
         currentFreq2 = calculateFrequency(fromMidiNote, 
-                                         properties["semi2"], 
-                                         properties["cent2"], 
-                                         properties["oct2"], 
-                                         properties["tune2"]);
+                                         params[Param::Semi2], 
+                                         params[Param::Cent2], 
+                                         params[Param::Oct2], 
+                                         params[Param::Tune2]);
         
         currentFreq3 = calculateFrequency(fromMidiNote, 
-                                         properties["semi3"], 
-                                         properties["cent3"], 
-                                         properties["oct3"], 
-                                         properties["tune3"]);
+                                         params[Param::Semi3], 
+                                         params[Param::Cent3], 
+                                         params[Param::Oct3], 
+                                         params[Param::Tune3]);
     } else {
         currentFreq1 = targetFreq1;
         currentFreq2 = targetFreq2;
         currentFreq3 = targetFreq3;
     }
     
+    for (int i = 0; i < 3; ++i) pickMipLevels(i);
+    
     // Update envelope parameters and trigger
-    ampEnv.setParameters(
-        properties["ampAttack"],
-        properties["ampDecay"],
-        properties["ampSustain"],
-        properties["ampRelease"]
+    bank->ampEnvelope.setParameters(
+        slot,
+        params[Param::AmpAttack],
+        params[Param::AmpDecay],
+        params[Param::AmpSustain],
+        params[Param::AmpRelease],
+        sampleRate
     );
     
-    filterEnv.setParameters(
-        properties["filterAttack"],
-        properties["filterDecay"],
-        properties["filterSustain"],
-        properties["filterRelease"]
+    bank->filterEnvelope.setParameters(
+        slot,
+        params[Param::FilterAttack],
+        params[Param::FilterDecay],
+        params[Param::FilterSustain],
+        params[Param::FilterRelease],
+        sampleRate
     );
     
-    ampEnv.noteOn();
-    filterEnv.noteOn();
+    bank->ampEnvelope.noteOn(slot);
+    bank->filterEnvelope.noteOn(slot);
     
     wave3Playing = true;  // Reset wave3 playback
     pos3 = 0.0f;       // Reset pos3
+    
+    spreadUnison();
 }
 
-void Synth::noteOff() {
-    ampEnv.noteOff();
-    filterEnv.noteOff();
+void Synth::lateWavetable(int osc, const Wavetable* table) {
+    if (osc == 0) currentWavetable1 = table;
+    else if (osc == 1) currentWavetable2 = table;
+    else currentWavetable3 = table;
+    // Null tables don't advance, so the phase is still at the start
+    pickMipLevels(osc);
+    if (osc == 0) spreadUnison();
 }
 
-void Synth::abort() {
-    ampEnv.abort();
-    isAborting = true;  // Set the aborting flag
+void Synth::pickMipLevels(int osc) {
+    // Alias-free levels for where the oscillator starts and ends
+    const Wavetable* tables[3] = {currentWavetable1, currentWavetable2, currentWavetable3};
+    const float targetFreqs[3] = {targetFreq1, targetFreq2, targetFreq3};
+    const float startFreq = bank->frequency[osc][slot];
+    mipStart[osc] = tables[osc] ? static_cast<float>(tables[osc]->levelFor(startFreq)) : 0.0f;
+    mipTarget[osc] = tables[osc] ? static_cast<float>(tables[osc]->levelFor(targetFreqs[osc])) : 0.0f;
 }
 
-void Synth::setProperties(const std::map<std::string, float>& props) {
-    for (const auto& [name, value] : props) {
-        properties[name] = value;
-        
-        // Remove the wavetable lookup code since it's now handled by PolySynth
-        // if (name == "wave1") {
-        //     auto it = wavetables->find(value);
-        //     if (it != wavetables->end()) {
-        //         currentWave1 = &(it->second);
-        //     }
-        // }
-        // if (name == "wave2") {
-        //     auto it = wavetables->find(value);
-        //     if (it != wavetables->end()) {
-        //         currentWave2 = &(it->second);
-        //     }
-        // }
+void Synth::spreadUnison() {
+    // Unison copies of a looping table start spread over it (golden ratio
+    // steps) so they don't phase in together. Copies of a one-shot sample
+    // all start at its beginning, or they would skip its attack.
+    int size1 = currentWavetable1 && isLooping1 ? currentWavetable1->size() : 0;
+    for (int k = 1; k < kMaxUnison; ++k) {
+        float spread = k * 0.618034f;
+        unisonPos[k] = (spread - std::floor(spread)) * size1;
     }
 }
 
-float Synth::processLFO(float deltaTime) {
-    float rate = properties["lfoRate"]; // Already in 0-1 range
-    float frequency;
-    
-    if (properties["lfoSync"] > 0.5f) {
-        // Sync to note frequency - rate becomes a multiplier/divider
-        frequency = this->frequency * rate;
-    } else {
-        // Free running - rate goes from 0.1 Hz to 20 Hz
-        frequency = 0.1f * std::pow(200.0f, rate);
-    }
+void Synth::noteOff() {
+    bank->ampEnvelope.noteOff(slot);
+    bank->filterEnvelope.noteOff(slot);
+}
 
-    lfoPhase += frequency * deltaTime;
-    if (lfoPhase >= 1.0f) lfoPhase -= 1.0f;
+void Synth::fastRelease() {
+    bank->ampEnvelope.fastRelease(slot);
+    bank->filterEnvelope.fastRelease(slot);
+}
+
+void Synth::setProperties(const SynthParams& props) {
+    params = props;
+    routing.compile(params);
+}
+
+void Synth::setProperties(const SynthParams& props, const ModMatrix& compiled) {
+    params = props;
+    routing = compiled;
+}
 
-    float waveform = properties["lfoWaveform"];
-    
-    // Generate LFO waveform
-    if (waveform < 1.0f) { // Triangle
-        lfoValue = (lfoPhase < 0.5f) ? 
-            4.0f * lfoPhase - 1.0f : 
-            3.0f - 4.0f * lfoPhase;
-    } else if (waveform < 2.0f) { // Sawtooth
-        lfoValue = 2.0f * lfoPhase - 1.0f;
-    } else if (waveform < 3.0f) { // Square
-        lfoValue = (lfoPhase < 0.5f) ? 1.0f : -1.0f;
-    } else if (waveform < 4.0f) { // Sample and Hold
-        if (lfoPhase < lastLfoPhase) {
-            lfoValue = 2.0f * (float)rand() / (float)RAND_MAX - 1.0f;
+float Synth::processLFO(float deltaTime, ModulationCache* shared) {
+    float rate = params[Param::LfoRate]; // Already in 0-1 range
+    bool sync = params[Param::LfoSync] > 0.5f;
+    
+    float value;
+    if (shared && !sync && params[Param::LfoRetrigger] <= 0.5f) {
+        // Free running and not restarted per note: every voice follows the
+        // one global LFO
+        value = shared->lfo();
+    } else {
+        float frequency;
+        if (sync) {
+            // Sync to note frequency - rate becomes a multiplier/divider
+            frequency = this->frequency * rate;
+        } else {
+            // Free running - rate goes from 0.1 Hz to 20 Hz
+            frequency = 0.1f * fastmath::exp2(rate * 7.64385619f);  // 200^rate
         }
-    } else { // Sine
-        lfoValue = std::sin(TWO_PI * lfoPhase);
+        value = lfo.advance(frequency, params[Param::LfoWaveform], deltaTime);
     }
-    
-    lastLfoPhase = lfoPhase;
 
     // Apply fade-in
-    float fadeInTime = properties["lfoFadeIn"];
+    float fadeInTime = params[Param::LfoFadeIn];
     float fadeInMultiplier = 1.0f;
     if (fadeInTime > 0.0f) {
         fadeInMultiplier = std::min(stateTime / fadeInTime, 1.0f);
     }
     
-    return lfoValue * properties["lfoAmount"] * fadeInMultiplier;
+    return value * fadeInMultiplier;
+}
+
+float Synth::processLFO2(float deltaTime, ModulationCache* shared) {
+    if (shared && params[Param::Lfo2Retrigger] <= 0.5f) return shared->lfo2();
+    float frequency = 0.1f * fastmath::exp2(params[Param::Lfo2Rate] * 7.64385619f);  // 200^rate
+    return lfo2.advance(frequency, params[Param::Lfo2Waveform], deltaTime);
 }
 
 void Synth::processBitcrusher(float* input, int numSamples, float bitcrushAmount, float sampleReduction) {
@@ -457,28 +572,3 @@ void Synth::processBitcrusher(float* input, int numSamples, float bitcrushAmount
         }
     }
 }
-
-void Synth::processDistortion(float* input, int numSamples, float amount, float character) {
-    // Pre-calculate gain and attenuation to avoid repeated calculations
-    float gain = 1.0f + amount * 8.0f;  // Boost input signal
-    float attenuation = 1.0f / (1.0f + amount);  // Output attenuation factor
-    
-    // Determine distortion type based on character parameter
-    // character: 0.0-0.33 = hard clip, 0.33-0.66 = soft clip, 0.66-1.0 = wavefolder
-    for (int i = 0; i < numSamples; i++) {
-        float x = input[i] ;
-        float p;
-        
-        // if (character < 0.33f) {
-            // Hard clipping
-            p = std::clamp(x* gain, -1.0f, 1.0f);
-        // } 
-        // else if (character < 0.66f) {
-        //     // Soft clipping (x / (1 + |x|))
-            // p = x / (1.0f + std::abs(x));
-        // }
-      
-        
-        input[i] = amount * p * attenuation + (1.0f - amount) * x;
-    }
-}
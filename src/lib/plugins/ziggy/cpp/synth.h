@@ -1,94 +1,20 @@
 #ifndef SYNTH_H
 #define SYNTH_H
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <map>
-#include <string>
+#include <memory>
+#include "distortion.h"
 #include "filter_coefficients.h"
-
-class ADSR {
-public:
-    ADSR() = default;
-    
-    void setParameters(float attack, float decay, float sustain, float release) {
-        this->attack = attack;
-        this->decay = decay;
-        this->sustain = sustain;
-        this->release = release;
-    }
-    
-    void noteOn() {
-        isNoteOn = true;
-        position = 0.0f;
-        level = 0.0f;
-    }
-    
-    void noteOff() {
-        isNoteOn = false;
-        noteOffTime = position;
-        releaseStartLevel = level;
-    }
-    
-    void abort() {
-        isNoteOn = false;
-        noteOffTime = position;
-        releaseStartLevel = level;
-        // Store original release time and set to quick release
-        originalRelease = release;
-        release = 0.05f; // 50ms abort time
-    }
-    
-    float process(float deltaTime) {
-        position += deltaTime;
-        level = calculateLevel(position);
-        
-        // Restore original release time once envelope is complete
-        if (!isActive() && release != originalRelease) {
-            release = originalRelease;
-        }
-        return level;
-    }
-    
-    bool isActive() const {
-        return isNoteOn || level > 0.0001f;
-    }
-    
-private:
-    float calculateLevel(float time) {
-        float level = 0.0f;
-        
-        if (isNoteOn) {
-            if (time < attack) {
-                level = time / attack + 0.00001f;
-            } else if (time < attack + decay) {
-                float decayPhase = time - attack;
-                level = 1.0f - (1.0f - sustain) * (decayPhase / decay) + 0.00001f;
-            } else {
-                level = sustain;
-            }
-        } else {
-            float releasePhase = time - noteOffTime;
-            if (releasePhase < release) {
-                level = releaseStartLevel * (1.0f - releasePhase / release);
-            } else {
-                level = 0.0f;
-            }
-        }
-        
-        return level;
-    }
-    
-    float attack = 0.1f;
-    float decay = 0.1f;
-    float sustain = 0.7f;
-    float release = 0.1f;
-    float position = 0.0f;
-    float level = 0.0f;
-    float noteOffTime = 0.0f;
-    float releaseStartLevel = 0.0f;
-    bool isNoteOn = false;
-    float originalRelease = 0.1f;  // Add this new member variable
-};
+#include "mod_matrix.h"
+#include "modulation_cache.h"
+#include "oscillator.h"
+#include "params.h"
+#include "smoothing.h"
+#include "voice_bank.h"
+#include "wavetable.h"
 
 // Add this enum before the Synth class
 enum class LFOWaveform {
@@ -99,15 +25,6 @@ enum class LFOWaveform {
     Sine
 };
 
-// Update the enum to include destination options
-enum class LFODestination {
-    Oscillators,
-    Filter,
-    FM,
-    Phase,
-    Mix
-};
-
 class Synth {
 public:
     enum class Waveform {
@@ -116,38 +33,60 @@ public:
         Saw
     };
 
-    Synth(float sampleRate = 44100.0f, std::map<float, std::map<int, std::vector<float>>>* wavetables = nullptr);
+    // Hot state (phases, frequencies, filter history, envelope levels)
+    // lives in bank's arrays at slot. Without a bank the voice owns a
+    // single-slot one.
+    Synth(float sampleRate = 44100.0f, VoiceBank* bank = nullptr, int slot = 0);
     
     // float process();
-    void processBuffer(float* buffer, int bufferSize);
+    // Renders bufferSize (at most kSubBlockSize) frames of the voice's
+    // unfiltered source into buffer (overwriting it), generates its
+    // envelopes and sets the bank's filter coefficients; the bank's lane
+    // stage applies the filter, amp envelope, velocity and pan.
+    //
+    // A block where the envelope stays below kInaudibleLevel throughout is
+    // skipped: buffer is zeroed and false returned. A released voice then
+    // ends, so it retires at the end of the block.
+    bool processBuffer(float* buffer, int bufferSize);
+    
+    // processBuffer in two halves, for voices rendered together, whose
+    // envelopes the caller generates first with the bank's
+    // processEnvelopes. prepare is the block-rate part (glide, LFO, filter
+    // coefficients), taking shared values from the cache when given; it
+    // returns false for an inaudible block, which is then not rendered.
+    // render writes the source. Only render may run concurrently with
+    // other voices.
+    bool prepare(int bufferSize, ModulationCache* shared);
+    void render(float* buffer, int bufferSize);
+    
+    // One 16-bit LSB, after velocity
+    static constexpr float kInaudibleLevel = 1.0f / 65536.0f;
     void noteOn(int midiNote, float velocity, int fromMidiNote = -1);
     void noteOff();
-    void setProperties(const std::map<std::string, float>& props);
+    // Releases over EnvelopeBank::kFastReleaseSeconds
+    void fastRelease();
+    void setProperties(const SynthParams& props);
+    // Same, with props' routing already compiled, as PolySynth shares it
+    void setProperties(const SynthParams& props, const ModMatrix& routing);
     // void setWavetable(const std::vector<float>& table);
     
-    float calculateEnvelopeLevel(float time);
-    bool isVoiceActive();
-    bool isActive = false;
-    bool isAborting = false;  // Add this new member
-    int midiNote = -1;
-    bool noteIsOn = false;
-    float noteOffTime = 0.0f;
-    float wavetableKey = 0.0f;
-    float releaseStartLevel = 0.0f;
-    int startTime = 0;
-    void abort();  // Add this declaration
-
-    float gainLeft = 0.707f;  // Default to center (-3dB)
-    float gainRight = 0.707f;
-    
-    // void setPanning(float left, float right) {
-    //     gainLeft = left;
-    //     gainRight = right;
-    // }
+    // True once the amp envelope has fully released
+    bool finished() const { return !bank->ampEnvelope.isActive(slot); }
+    bool released() const { return bank->ampEnvelope.released(slot); }
+    // Still rising to its peak, so about to be louder than it is
+    bool attacking() const { return bank->ampEnvelope.attacking(slot); }
+    void seedRandom(uint32_t seed) {
+        lfo.randomState = seed;
+        lfo2.randomState = seed ^ 0x9e3779b9u;
+    }
 
-    void setWavetable1(const std::vector<float>* table) { currentWavetable1 = table; }
-    void setWavetable2(const std::vector<float>* table) { currentWavetable2 = table; }
-    void setWavetable3(const std::vector<float>* table) { currentWavetable3 = table; }
+    void setWavetable1(const Wavetable* table) { currentWavetable1 = table; }
+    void setWavetable2(const Wavetable* table) { currentWavetable2 = table; }
+    void setWavetable3(const Wavetable* table) { currentWavetable3 = table; }
+    // Oscillator osc's table (0-2) arrived after noteOn, e.g. a file decoded
+    // on first use. The oscillator starts from the top of it, at the levels
+    // noteOn would have picked for the current pitch.
+    void lateWavetable(int osc, const Wavetable* table);
     
     // Remove the separate methods for setting wavetable properties
     // void setWavetable1Properties(float tune, bool loop);
@@ -162,133 +101,94 @@ private:
     // Helper method for noise generation
     float processNoise(float deltaTime, float color);
     
-    std::map<std::string, float> properties = {
-        // Amplitude envelope parameters
-        {"ampAttack", 0.5f},
-        {"ampDecay", 0.1f},
-        {"ampSustain", 0.7f},
-        {"ampRelease", 0.9f},
-        
-        // Filter envelope parameters
-        {"filterAttack", 0.1f},
-        {"filterDecay", 0.1f},
-        {"filterSustain", 0.7f},
-        {"filterRelease", 0.1f},
-        {"filterEnvAmount", 0.5f},
-        {"lastFilterType", 0.0f},
-        
-        // Filter parameters
-        {"cutoff", 1000.0f},
-        {"resonance", 0.0f},
-        {"filterKeyTracking", 1.0f},  // Add this new property
-        
-        // Oscillator parameters
-        {"wave1", 0.0f},
-        {"phaseOffset1", 0.0f},
-        {"phaseMode1", 0.0f},
-        {"wave2", 0.0f},
-        {"phaseOffset2", 0.0f},
-        {"phaseMode2", 0.0f},
-        {"wave3", 0.0f},
-        {"phaseOffset3", 0.0f},
-        {"phaseMode3", 0.0f},
-        {"oct1", 0.0f},
-        {"oct2", 0.0f},
-        {"oct3", 0.0f},
-        {"semi1", 0.0f},
-        {"semi2", 0.0f},
-        {"semi3", 0.0f},
-        {"cent1", 0.0f},
-        {"cent2", 0.0f},
-        {"cent3", 0.0f},
-        {"fmAmount", 0.0f},
-        {"mix", 0.5f},
-        {"wave3Mix", 0.0f},
-        {"osc2Enabled", 1.0f},
-        {"osc3Enabled", 0.0f},
-        
-        // Simplified LFO parameters
-        {"lfoSync", 0.0f},      // 0 = free, 1 = sync
-        {"lfoRate", 0.5f},      // 0-1 range
-        {"lfoAmount", 0.0f},    // 0-1 range
-        {"lfoWaveform", 0.0f},  // 0=Triangle, 1=Saw, 2=Square, 3=S&H, 4=Sine
-        {"lfoDestination", 0.0f}, // 0=Osc, 1=Filter, 2=FM, 3=Phase, 4=Mix
-        
-        
-        // Add noise generator parameters
-        {"noiseDecay", 0.1f},
-        {"noiseColor", 1.0f},  // 0 = dark, 1 = bright
-        {"noiseLevel", 0.0f},
-        // {"noiseEnabled", 0.0f},
-        
-        // Add new wave3 parameters
-        {"wave3Decay", 0.1f},
-        {"wave3Level", 0.0f},
-        
-        // Update these property names
-        {"tune1", 0.0f},
-        {"tune2", 0.0f},
-        {"tune3", 0.0f},
-        {"loop1", 1.0f},
-        {"loop2", 1.0f},
-        {"loop3", 1.0f},
-    };
+    SynthParams params;
+
+    std::unique_ptr<VoiceBank> ownBank;
+    VoiceBank* bank;
+    int slot;
 
     float sampleRate;
-    float pos1 = 0.0f;  // Position for oscillator 1 (renamed from phase1)
-    float pos2 = 0.0f;  // Position for oscillator 2 (renamed from phase2)
-    float pos3 = 0.0f;  // Position for oscillator 3 (renamed from phase3)
-    float envLevel = 0.f;
+    float cutoffOctaves;  // log2(sampleRate / 160), span of the cutoff mapping
+    // Table increments are tuned for kTableRate playback; every oscillator
+    // increment is scaled by kTableRate / sampleRate to keep its pitch
+    static constexpr float kTableRate = 44100.0f;
+    float pitchScale;
+    int midiNote = -1;
     float frequency = 440.0f;
-    float velocity = 0.0f;
-    float envPos = 0.0f;
-    float filterState = 0.0f;
     
     // std::vector<float> wavetable;
     // size_t wavetableSize = 0;
     
-    const std::vector<float>* currentWavetable1 = nullptr;
-    const std::vector<float>* currentWavetable2 = nullptr;
-    const std::vector<float>* currentWavetable3 = nullptr;
+    const Wavetable* currentWavetable1 = nullptr;
+    const Wavetable* currentWavetable2 = nullptr;
+    const Wavetable* currentWavetable3 = nullptr;
     
-    float processOscillator(const float* wavetableData, int wavetableSize, float freq, float& pos, bool shouldLoop);
-    float processEnvelope();
-    void processFilter(float* input, int numSamples, float cutoff01);
+    // Mip level per oscillator at note start and at the portamento target;
+    // voices crossfade between adjacent levels while gliding
+    float mipStart[3] = {0.0f, 0.0f, 0.0f};
+    float mipTarget[3] = {0.0f, 0.0f, 0.0f};
+    void pickMipLevels(int osc);
+    
+    // Sets this block's biquad coefficients in the bank
+    void updateFilter(float cutoff01, ModulationCache* shared);
     void updateWavetable();
 
-    // Filter state variables
-    float x1 = 0.0f, x2 = 0.0f;  // Input history
-    float y1 = 0.0f, y2 = 0.0f;  // Output history
-    
-    // Add second set of filter state variables for 24dB slope
-    float x1_2 = 0.0f, x2_2 = 0.0f;  // Second stage input history
-    float y1_2 = 0.0f, y2_2 = 0.0f;  // Second stage output history
-    
-    // Cached filter coefficients
-    float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f;
-    float a1 = 0.0f, a2 = 0.0f;
+    // Filter coefficients in use at the end of the last block, and the
+    // cached set for the current cutoff
+    BiquadCoefficients coeffs = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    BiquadCoefficients targetCoeffs = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
     float lastCutoff = -1.0f;
     float lastResonance = -1.0f;
 
-    ADSR ampEnv;
-    ADSR filterEnv;
-
     // Add baseCutoff member variable
     // float baseCutoff = 1000.0f;
 
     // Change lastFilterType from float to FilterType
     float lastFilterType = 0;
 
-    // Add lastAmpEnvLevel member variable
-    float lastAmpEnvLevel = 0.0f;
-
-    // Add these member variables
-    float lfoPhase = 0.0f;
-    float lfoValue = 0.0f;
-    float lastLfoPhase = 0.0f;  // Add this new member
-    
-    // Add this helper method
-    float processLFO(float deltaTime);
+    // The voice's own LFO, for sync and retrigger; otherwise voices follow
+    // the global one in the modulation cache
+    LfoState lfo;
+    LfoState lfo2;
+    
+    // LFO 1 after fade-in, before its amount
+    float processLFO(float deltaTime, ModulationCache* shared);
+    float processLFO2(float deltaTime, ModulationCache* shared);
+    
+    // The patch's modulation routes, latched with it at note on
+    ModMatrix routing;
+    // Phase destination at the end of the last block, in cycles
+    float phaseShift = 0.0f;
+    
+    // Modulated values prepare leaves for render
+    struct BlockState {
+        // Oscillator increments at the block's start (the last block's end)
+        // and end; render ramps between them
+        float freqFrom[3] = {1.0f, 1.0f, 1.0f};
+        float freq[3] = {1.0f, 1.0f, 1.0f};
+        float glide = 1.0f;
+        float fmAmount = 0.0f;
+        float mix = 0.0f;
+        // Phase destination, in cycles, at the block's start and end
+        float phaseFrom = 0.0f;
+        float phaseTo = 0.0f;
+    } block;
+    
+    // Unison on osc1: detuned copies with their own positions (copy 0 uses
+    // the bank's phase), spread over +-kUnisonSpreadCents at full detune
+    static constexpr float kUnisonSpreadCents = 50.0f;
+    int unisonCount = 1;
+    float unisonDetune = -1.0f;
+    float unisonGain = 1.0f;
+    float unisonRatio[kMaxUnison] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+    float unisonPos[kMaxUnison] = {};
+    void updateUnison();
+    void spreadUnison();
+    // Moves osc1's position, and its unison copies', by samples
+    void shiftOsc1(float samples);
+    // Osc1 with unison if enabled; modulator as renderWavetableFM, or nullptr
+    void renderOsc1(const OscTable& table, float increment, const float* modulator, float& pos,
+                    float* out, int n);
 
     // // Helper functions to get properties with default values
     // float getProperty(const std::string& name) const {
@@ -296,13 +196,15 @@ private:
     //     return it != properties.end() ? it->second : 0.0f;
     // }
 
-    std::vector<float> oscillatorOutput;
+    std::vector<float> oscScratch;  // osc2 / wave3 block before mixing
+    std::vector<float> rampBuffer;  // per-sample FM amount / mix / oscillator steps
+    
+    // Per-sample ramps for block-rate modulation targets. Cleared on note
+    // on so a new note starts at its own values instead of gliding in.
+    ParamRamp fmRamp;
+    ParamRamp mixRamp;
+    bool smoothingPrimed = false;
 
-    float targetFrequency = 440.0f;
-    float currentFrequency = 440.0f;
-    float currentFreq1 = 261.63f;
-    float currentFreq2 = 261.63f;
-    float currentFreq3 = 261.63f;
     float targetFreq1 = 261.63f;
     float targetFreq2 = 261.63f;
     float targetFreq3 = 261.63f;
@@ -317,17 +219,18 @@ private:
     
     bool wave3Playing = false;
 
-    // Add these member variables
-    const std::map<int, std::vector<float>>* currentWave1 = nullptr;
-    const std::map<int, std::vector<float>>* currentWave2 = nullptr;
-
-    void processDistortion(float* input, int numSamples, float amount, float character);
+    Distortion distortion{kSubBlockSize};
 
     // Add these new member variables to store loop state
     bool isLooping1 = true;
     bool isLooping2 = true;
     bool isLooping3 = true;
 
+    // Fractional mip level for an oscillator, glide is portamento progress 0-1
+    float mipLevel(int osc, float glide) const;
+    // An oscillator's read this block: its mip level and interpolation tier
+    OscTable oscTable(const Wavetable& wavetable, int osc, float glide) const;
+
     float calculateFrequency(int midiNote, float semi, float cent, float oct, float tune);
 };
 
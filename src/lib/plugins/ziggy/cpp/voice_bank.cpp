@@ -0,0 +1,221 @@
+#include "voice_bank.h"
+#include <algorithm>
+#include <cmath>
+#include "simd.h"
+
+using namespace simd;
+
+namespace {
+
+// Input for unused lanes
+alignas(16) const float kSilence[kSubBlockSize] = {};
+
+// Filter state below this (-300 dB) is flushed to zero between blocks so a
+// decaying voice never reaches denormals, on targets without FTZ/DAZ too
+constexpr float kStateFloor = 1e-15f;
+
+float flushed(float x) { return std::fabs(x) < kStateFloor ? 0.0f : x; }
+
+// One biquad per lane
+struct LaneBiquad {
+    f32x4 b0, b1, b2, a1, a2;
+};
+
+LaneBiquad loadBiquad(const float (*c)[VoiceBank::kLanes]) {
+    return {load(c[0]), load(c[1]), load(c[2]), load(c[3]), load(c[4])};
+}
+
+// start + delta * t for every coefficient
+LaneBiquad lerp(const LaneBiquad& start, const LaneBiquad& delta, f32x4 t) {
+    return {madd(delta.b0, t, start.b0), madd(delta.b1, t, start.b1), madd(delta.b2, t, start.b2),
+            madd(delta.a1, t, start.a1), madd(delta.a2, t, start.a2)};
+}
+
+LaneBiquad difference(const LaneBiquad& to, const LaneBiquad& from) {
+    return {sub(to.b0, from.b0), sub(to.b1, from.b1), sub(to.b2, from.b2),
+            sub(to.a1, from.a1), sub(to.a2, from.a2)};
+}
+
+// Transposed direct form II: two state registers per stage, and the
+// recursion runs across lanes rather than along time
+inline f32x4 tick(const LaneBiquad& c, f32x4 x, f32x4& z1, f32x4& z2) {
+    f32x4 y = madd(c.b0, x, z1);
+    z1 = sub(madd(c.b1, x, z2), mul(c.a1, y));
+    z2 = sub(mul(c.b2, x), mul(c.a2, y));
+    return y;
+}
+
+}
+
+VoiceBank::VoiceBank(int voices)
+    : active(voices, 0), note(voices, -1), startTime(voices, 0),
+      filterFrom(voices, BiquadCoefficients{}), filterTo(voices, BiquadCoefficients{}),
+      filterCascade(voices, 0),
+      s1(voices, 0.0f), s2(voices, 0.0f), s1b(voices, 0.0f), s2b(voices, 0.0f),
+      ampEnvelope(voices), filterEnvelope(voices), velocity(voices, 0.0f),
+      gainLeft(voices, 0.707f), gainRight(voices, 0.707f),
+      voices(voices), ampBlocks(static_cast<size_t>(voices + kLanes - 1) / kLanes * kLanes * kSubBlockSize, 0.0f),
+      slotOrder(voices), slotPosition(voices) {
+    for (int n = 0; n < 3; ++n) {
+        phase[n].assign(voices, 0.0f);
+        frequency[n].assign(voices, 261.63f);
+    }
+    for (int v = 0; v < voices; ++v) {
+        slotOrder[v] = v;
+        slotPosition[v] = v;
+    }
+}
+
+void VoiceBank::swapSlots(int a, int b) {
+    int positionA = slotPosition[a];
+    int positionB = slotPosition[b];
+    slotOrder[positionA] = b;
+    slotOrder[positionB] = a;
+    slotPosition[a] = positionB;
+    slotPosition[b] = positionA;
+}
+
+void VoiceBank::activate(int v) {
+    if (active[v]) return;
+    active[v] = 1;
+    // v moves to the end of the active list
+    swapSlots(v, slotOrder[activeTotal]);
+    activeTotal++;
+}
+
+void VoiceBank::deactivate(int v) {
+    if (!active[v]) return;
+    active[v] = 0;
+    // The last active slot fills v's place; v heads the idle list
+    swapSlots(v, slotOrder[activeTotal - 1]);
+    activeTotal--;
+}
+
+void VoiceBank::processEnvelopes(const int* slots, int count, int frames) {
+    static_assert(EnvelopeBank::kLanes == kLanes, "envelope lanes are voice lanes");
+    for (int first = 0; first < count; first += kLanes) {
+        int lanes[kLanes];
+        for (int l = 0; l < kLanes; ++l) {
+            lanes[l] = first + l < count ? slots[first + l] : -1;
+        }
+        ampEnvelope.process(lanes, ampLanes(first / kLanes), frames);
+        // The filter follows its envelope once per block
+        filterEnvelope.process(lanes, nullptr, frames);
+    }
+}
+
+void VoiceBank::processLanes(const int* slots, const float* const* inputs, const float* amp, float* output,
+                             int frames) {
+    alignas(16) float vel[kLanes], left[kLanes], right[kLanes];
+    alignas(16) float state[4][kLanes];
+    // b0, b1, b2, a1, a2 by lane, for each stage at both ends of the block
+    alignas(16) float from[5][kLanes], to[5][kLanes], from2[5][kLanes], to2[5][kLanes];
+    const float* in[kLanes];
+    bool cascade = false;
+    for (int l = 0; l < kLanes; ++l) {
+        int v = slots[l];
+        if (v < 0) {
+            vel[l] = left[l] = right[l] = 0.0f;
+            for (int c = 0; c < 5; ++c) from[c][l] = to[c][l] = from2[c][l] = to2[c][l] = 0.0f;
+            for (int k = 0; k < 4; ++k) state[k][l] = 0.0f;
+            in[l] = kSilence;
+            continue;
+        }
+        vel[l] = velocity[v];
+        left[l] = gainLeft[v];
+        right[l] = gainRight[v];
+        in[l] = inputs[l];
+
+        const BiquadCoefficients& a = filterFrom[v];
+        const BiquadCoefficients& b = filterTo[v];
+        const float fromSet[5] = {a.b0, a.b1, a.b2, a.a1, a.a2};
+        const float toSet[5] = {b.b0, b.b1, b.b2, b.a1, b.a2};
+        // Lanes without a second stage pass through an identity biquad,
+        // which is exact and leaves that stage's state at zero
+        const float identity[5] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        const bool second = filterCascade[v] != 0;
+        cascade |= second;
+        for (int c = 0; c < 5; ++c) {
+            from[c][l] = fromSet[c];
+            to[c][l] = toSet[c];
+            from2[c][l] = second ? fromSet[c] : identity[c];
+            to2[c][l] = second ? toSet[c] : identity[c];
+        }
+        state[0][l] = s1[v];
+        state[1][l] = s2[v];
+        state[2][l] = s1b[v];
+        state[3][l] = s2b[v];
+    }
+
+    const f32x4 velV = load(vel), leftV = load(left), rightV = load(right);
+    f32x4 z1 = load(state[0]), z2 = load(state[1]), z1b = load(state[2]), z2b = load(state[3]);
+
+    // Coefficients step towards the block-end set every kFilterSubBlock
+    // samples. The stable region of (a1, a2) is convex, so every
+    // intermediate filter is stable.
+    const LaneBiquad start = loadBiquad(from), start2 = loadBiquad(from2);
+    const LaneBiquad delta = difference(loadBiquad(to), start);
+    const LaneBiquad delta2 = difference(loadBiquad(to2), start2);
+
+    for (int begin = 0; begin < frames; begin += kFilterSubBlock) {
+        const int end = std::min(begin + kFilterSubBlock, frames);
+        const f32x4 t = set1(static_cast<float>(end) / frames);
+        const LaneBiquad coeffs = lerp(start, delta, t);
+        const LaneBiquad coeffs2 = lerp(start2, delta2, t);
+
+        int i = begin;
+        for (; i + 4 <= end; i += 4) {
+            // Rows are voices; after the transpose each register holds one
+            // sample of every lane
+            f32x4 x0 = load(in[0] + i), x1 = load(in[1] + i), x2 = load(in[2] + i), x3 = load(in[3] + i);
+            transpose(x0, x1, x2, x3);
+
+            f32x4 y[4] = {x0, x1, x2, x3};
+            f32x4 l[4], r[4];
+            for (int k = 0; k < 4; ++k) {
+                f32x4 filtered = tick(coeffs, y[k], z1, z2);
+                if (cascade) filtered = tick(coeffs2, filtered, z1b, z2b);
+                f32x4 gained = mul(filtered, mul(load(amp + (i + k) * kLanes), velV));
+                l[k] = mul(gained, leftV);
+                r[k] = mul(gained, rightV);
+            }
+
+            // Back to rows of lanes and sum them: one register per channel
+            // holding samples i..i+3
+            transpose(l[0], l[1], l[2], l[3]);
+            transpose(r[0], r[1], r[2], r[3]);
+            f32x4 sumL = add(add(l[0], l[1]), add(l[2], l[3]));
+            f32x4 sumR = add(add(r[0], r[1]), add(r[2], r[3]));
+
+            f32x4 lo, hi;
+            interleave(sumL, sumR, lo, hi);
+            store(output + i * 2, lo);
+            store(output + i * 2 + 4, hi);
+        }
+
+        // Block sizes that aren't a multiple of 4 finish one sample at a time
+        for (; i < end; ++i) {
+            f32x4 filtered = tick(coeffs, set(in[0][i], in[1][i], in[2][i], in[3][i]), z1, z2);
+            if (cascade) filtered = tick(coeffs2, filtered, z1b, z2b);
+            f32x4 gained = mul(filtered, mul(load(amp + i * kLanes), velV));
+            alignas(16) float l[kLanes], r[kLanes];
+            store(l, mul(gained, leftV));
+            store(r, mul(gained, rightV));
+            output[i * 2] = (l[0] + l[1]) + (l[2] + l[3]);
+            output[i * 2 + 1] = (r[0] + r[1]) + (r[2] + r[3]);
+        }
+    }
+
+    store(state[0], z1);
+    store(state[1], z2);
+    store(state[2], z1b);
+    store(state[3], z2b);
+    for (int l = 0; l < kLanes; ++l) {
+        int v = slots[l];
+        if (v < 0) continue;
+        s1[v] = flushed(state[0][l]);
+        s2[v] = flushed(state[1][l]);
+        s1b[v] = flushed(state[2][l]);
+        s2b[v] = flushed(state[3][l]);
+    }
+}
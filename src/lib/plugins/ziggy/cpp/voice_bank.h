@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "envelope.h"
+#include "filter_coefficients.h"
+
+// Longest stretch the voice path renders in one go. PolySynth splits host
+// blocks of any size into sub-blocks of at most this many frames, so voice
+// scratch buffers are fixed size.
+constexpr int kSubBlockSize = 128;
+
+// Hot per-voice state as structure-of-arrays: one packed array per field,
+// indexed by voice slot, so scanning voices touches a few cache lines instead
+// of a whole Synth each. Active and idle slots are kept in compact lists.
+//
+// Voices render their source one at a time into mono blocks; the lane stage
+// then runs kLanes voices in lockstep, one voice per SIMD lane: filter, amp
+// envelope, velocity and pan. Envelopes are generated the same way, ahead of
+// the voices' control pass.
+class VoiceBank {
+public:
+    static constexpr int kLanes = 4;
+    // Filter coefficients step from filterFrom to filterTo once per sub-block
+    static constexpr int kFilterSubBlock = 16;
+
+    explicit VoiceBank(int voices);
+
+    int size() const { return voices; }
+
+    // Active slots in activation order. Deactivating swaps the last entry
+    // into the hole, so the order depends only on the note sequence.
+    const int* activeSlots() const { return slotOrder.data(); }
+    int activeCount() const { return activeTotal; }
+    bool isActive(int v) const { return active[v] != 0; }
+    // The idle slot activate would be cheapest for: the most recently
+    // deactivated one. -1 when every slot is active.
+    int idleSlot() const { return activeTotal < voices ? slotOrder[activeTotal] : -1; }
+    void activate(int v);
+    void deactivate(int v);
+
+    // Generates the next frames samples of both envelopes for count slots,
+    // taken kLanes at a time as the lane stage groups them; group g's amp
+    // envelope goes to ampLanes(g)
+    void processEnvelopes(const int* slots, int count, int frames);
+
+    // Filters each lane, applies its amp envelope, velocity and pan and
+    // writes the sum as interleaved stereo. slots has kLanes entries, -1 for
+    // an unused lane; inputs[l] is lane l's mono block and amp the group's
+    // envelope from processEnvelopes. Advances the lanes' filter state.
+    void processLanes(const int* slots, const float* const* inputs, const float* amp, float* output,
+                      int frames);
+
+    // Voice status
+    std::vector<uint8_t> active;
+    std::vector<int32_t> note;
+    std::vector<int32_t> startTime;
+
+    // Table position and current frequency of each oscillator
+    std::vector<float> phase[3];
+    std::vector<float> frequency[3];
+
+    // Biquad coefficients at the start and end of the block, and whether a
+    // second identical stage follows (Lowpass 24)
+    std::vector<BiquadCoefficients> filterFrom;
+    std::vector<BiquadCoefficients> filterTo;
+    std::vector<uint8_t> filterCascade;
+
+    // Transposed direct form II state; the b pair belongs to the second stage
+    std::vector<float> s1, s2;
+    std::vector<float> s1b, s2b;
+
+    EnvelopeBank ampEnvelope;
+    EnvelopeBank filterEnvelope;
+    // This block's amp envelope for lane group g, lanes interleaved
+    float* ampLanes(int g) { return &ampBlocks[static_cast<size_t>(g) * kSubBlockSize * kLanes]; }
+    std::vector<float> velocity;
+    std::vector<float> gainLeft;
+    std::vector<float> gainRight;
+
+private:
+    void swapSlots(int a, int b);
+
+    int voices;
+    std::vector<float> ampBlocks;
+    // Active slots first, then idle ones; both lists change in O(1) by
+    // swapping across the boundary at activeTotal
+    std::vector<int> slotOrder;
+    std::vector<int> slotPosition;  // slot -> index in slotOrder
+    int activeTotal = 0;
+};
@@ -0,0 +1,208 @@
+#include "wavetable.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Complex = std::complex<double>;
+
+// In-place iterative radix-2 FFT, a.size() must be a power of two
+void fft(std::vector<Complex>& a, bool inverse) {
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double angle = 2.0 * M_PI / len * (inverse ? 1.0 : -1.0);
+        Complex wlen(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < n; i += len) {
+            Complex w(1.0);
+            for (size_t k = 0; k < len / 2; ++k) {
+                Complex u = a[i + k];
+                Complex v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+    if (inverse) {
+        for (auto& x : a) x /= static_cast<double>(n);
+    }
+}
+
+// Arbitrary-length DFT via Bluestein's chirp-z transform. Tables are rarely a
+// power of two (the UI resamples to multiples of 1348), so the chirp is built
+// once and reused for every mip level.
+class Dft {
+public:
+    explicit Dft(size_t n) : n(n) {
+        m = 1;
+        while (m < 2 * n - 1) m <<= 1;
+        chirp.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            // k^2 mod 2n keeps the angle small for large tables
+            double angle = M_PI * static_cast<double>((k * k) % (2 * n)) / n;
+            chirp[k] = Complex(std::cos(angle), -std::sin(angle));
+        }
+        kernel.assign(m, Complex(0.0));
+        kernel[0] = std::conj(chirp[0]);
+        for (size_t k = 1; k < n; ++k) {
+            kernel[k] = kernel[m - k] = std::conj(chirp[k]);
+        }
+        fft(kernel, false);
+    }
+
+    std::vector<Complex> forward(const std::vector<Complex>& x) const {
+        std::vector<Complex> a(m, Complex(0.0));
+        for (size_t k = 0; k < n; ++k) a[k] = x[k] * chirp[k];
+        fft(a, false);
+        for (size_t k = 0; k < m; ++k) a[k] *= kernel[k];
+        fft(a, true);
+        std::vector<Complex> out(n);
+        for (size_t k = 0; k < n; ++k) out[k] = a[k] * chirp[k];
+        return out;
+    }
+
+    std::vector<Complex> inverse(const std::vector<Complex>& x) const {
+        std::vector<Complex> conjugated(n);
+        for (size_t k = 0; k < n; ++k) conjugated[k] = std::conj(x[k]);
+        std::vector<Complex> out = forward(conjugated);
+        for (auto& v : out) v = std::conj(v) / static_cast<double>(n);
+        return out;
+    }
+
+private:
+    size_t n;
+    size_t m;
+    std::vector<Complex> chirp;
+    std::vector<Complex> kernel;
+};
+
+// Nearest half float, ties to even; out of range values clamp to +-65504
+uint16_t toHalf(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const float magnitude = std::fabs(x);
+    if (!(magnitude < 65520.0f)) return sign | 0x7bff;
+    // Subnormal halves are whole multiples of 2^-24
+    if (magnitude < 6.103515625e-05f) return sign | static_cast<uint16_t>(std::nearbyint(magnitude * 16777216.0f));
+
+    std::memcpy(&bits, &magnitude, sizeof(bits));
+    // Round the mantissa to 10 bits, then rebias the exponent from 127 to 15
+    bits += 0xfff + ((bits >> 13) & 1);
+    return sign | static_cast<uint16_t>((bits >> 13) - ((127 - 15) << 10));
+}
+
+}
+
+Wavetable::Wavetable(void* storage, int size, SampleFormat format)
+    : data(storage), length(size), stride(size + kTableGuard), levels(levelsFor(size)), format(format) {}
+
+int Wavetable::levelsFor(int size) {
+    int levels = 1;
+    if (size >= 4 && size <= kMaxMipSize) {
+        // Level l keeps size / 2^(l+1) harmonics, so stop at one harmonic
+        while (levels < kMaxLevels && (size >> (levels + 1)) >= 1) levels++;
+    }
+    return levels;
+}
+
+size_t Wavetable::storageFor(int size, SampleFormat format) {
+    size_t samples = static_cast<size_t>(size + kTableGuard) * levelsFor(size);
+    return (samples * bytesPerSample(format) + sizeof(float) - 1) / sizeof(float);
+}
+
+void Wavetable::finalize() {
+    if (!data || length <= 0 || format != SampleFormat::Float32) return;
+    if (levels > 1) buildMipLevels();
+
+    // Wrap-around guard after every level
+    for (int l = 0; l < levels; ++l) {
+        float* table = static_cast<float*>(data) + static_cast<size_t>(l) * stride;
+        for (int i = 0; i < kTableGuard; ++i) {
+            table[length + i] = table[i % length];
+        }
+    }
+}
+
+void Wavetable::finalize(const float* source) {
+    if (!data || length <= 0) return;
+    if (format == SampleFormat::Float32) {
+        std::copy(source, source + length, samples());
+        finalize();
+        return;
+    }
+
+    std::vector<float> levelData(storageFor(length));
+    Wavetable staging(levelData.data(), length);
+    std::copy(source, source + length, staging.samples());
+    staging.finalize();
+    encode(levelData.data());
+}
+
+void Wavetable::encode(const float* levelData) {
+    const size_t count = static_cast<size_t>(stride) * levels;
+    uint16_t* out = static_cast<uint16_t*>(data);
+    if (format == SampleFormat::Half) {
+        for (size_t i = 0; i < count; ++i) out[i] = toHalf(levelData[i]);
+        return;
+    }
+
+    // One scale for every level, so a crossfade between two reads the same
+    // steps; the band-limited levels can overshoot level 0
+    float peak = 0.0f;
+    for (size_t i = 0; i < count; ++i) peak = std::max(peak, std::fabs(levelData[i]));
+    step = peak > 0.0f ? peak / 32767.0f : 1.0f;
+    for (size_t i = 0; i < count; ++i) {
+        long value = std::lround(levelData[i] / step);
+        out[i] = static_cast<uint16_t>(static_cast<int16_t>(std::clamp(value, -32767L, 32767L)));
+    }
+}
+
+void Wavetable::buildMipLevels() {
+    // Band-limit each level by truncating harmonics in the frequency domain
+    Dft dft(length);
+    std::vector<Complex> source(length);
+    const float* level0 = static_cast<const float*>(data);
+    for (int i = 0; i < length; ++i) source[i] = level0[i];
+    const std::vector<Complex> spectrum = dft.forward(source);
+
+    std::vector<Complex> truncated(length);
+    for (int l = 1; l < levels; ++l) {
+        const int maxHarmonic = length >> (l + 1);
+        for (int k = 0; k < length; ++k) {
+            int harmonic = std::min(k, length - k);
+            truncated[k] = harmonic <= maxHarmonic ? spectrum[k] : Complex(0.0);
+        }
+        const std::vector<Complex> band = dft.inverse(truncated);
+        float* table = static_cast<float*>(data) + static_cast<size_t>(l) * stride;
+        for (int i = 0; i < length; ++i) table[i] = static_cast<float>(band[i].real());
+    }
+}
+
+int Wavetable::levelFor(float increment) const {
+    if (increment <= 1.0f) return 0;
+    int level = static_cast<int>(std::ceil(std::log2(increment)));
+    return std::min(level, levels - 1);
+}
+
+OscTable Wavetable::read(float level) const {
+    level = std::clamp(level, 0.0f, static_cast<float>(levels - 1));
+    int lower = static_cast<int>(level);
+    float blend = level - lower;
+    OscTable table = {this->level(lower), nullptr, 0.0f, length, format, step};
+    if (blend > 0.0f && lower + 1 < levels) {
+        table.blendData = this->level(lower + 1);
+        table.blend = blend;
+    }
+    return table;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include "oscillator.h"
+
+// A wavetable and its band-limited mip levels, laid out contiguously in
+// storage owned elsewhere (see WavetableArena). Every level has the same
+// length as level 0, so a voice keeps its position when it moves between
+// levels, and each carries kTableGuard wrap-around samples. Level l keeps
+// harmonics up to size / 2^(l+1) and is alias-free for playback increments up
+// to 2^l; level 0 is the original table.
+//
+// Samples are float, or one of the compact SampleFormats at half the size;
+// the kernels convert compact samples as they read them.
+class Wavetable {
+public:
+    static constexpr int kMaxLevels = 10;
+    // Longer tables are one-shot samples rather than single cycles and keep
+    // only level 0
+    static constexpr int kMaxMipSize = 16384;
+
+    Wavetable() = default;
+    // View over storageFor(size, format) floats. For a float table the
+    // caller writes level 0 through samples() (e.g. a single HEAPF32.set
+    // from JS), then finalize() builds the mip levels and guards in place.
+    // Any table can instead be built from float samples with
+    // finalize(source).
+    Wavetable(void* storage, int size, SampleFormat format = SampleFormat::Float32);
+
+    static int levelsFor(int size);
+    // In floats, whatever the format
+    static size_t storageFor(int size, SampleFormat format = SampleFormat::Float32);
+
+    // nullptr for compact tables
+    float* samples() { return format == SampleFormat::Float32 ? static_cast<float*>(data) : nullptr; }
+    void finalize();
+    // Builds the table from size float samples. Compact levels are worked
+    // out in float first, then converted; allocates, so control side only.
+    void finalize(const float* source);
+
+    int size() const { return length; }
+    int numLevels() const { return levels; }
+    SampleFormat sampleFormat() const { return format; }
+    // Bytes of samples, all levels and guards included
+    size_t bytes() const { return static_cast<size_t>(stride) * levels * bytesPerSample(format); }
+    const void* level(int l) const {
+        return static_cast<const char*>(data) + static_cast<size_t>(l) * stride * bytesPerSample(format);
+    }
+
+    // Lowest alias-free level for a playback increment
+    int levelFor(float increment) const;
+
+    // Table read for a fractional level, blending level floor(l) into floor(l) + 1
+    OscTable read(float level) const;
+
+    static size_t bytesPerSample(SampleFormat format) { return format == SampleFormat::Float32 ? 4 : 2; }
+
+private:
+    void buildMipLevels();
+    // Converts a float table of the same size and levels into this one
+    void encode(const float* levelData);
+
+    void* data = nullptr;
+    int length = 0;
+    int stride = 0;
+    int levels = 0;
+    SampleFormat format = SampleFormat::Float32;
+    float step = 1.0f;  // Int16: the value of one step
+};
@@ -0,0 +1,174 @@
+#include "wavetable_arena.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+constexpr size_t kAlignFloats = WavetableArena::kAlignment / sizeof(float);
+
+inline size_t alignUp(size_t count) {
+    return (count + kAlignFloats - 1) / kAlignFloats * kAlignFloats;
+}
+
+inline uint32_t slotIndex(TableHandle handle) { return handle & 0xffffu; }
+inline uint32_t slotGeneration(TableHandle handle) { return handle >> 16; }
+
+}
+
+WavetableArena::WavetableArena(size_t capacityBytes)
+    : capacity(alignUp(capacityBytes / sizeof(float))),
+      slots(new Slot[kMaxTables]) {
+    // Over-allocate so the usable block starts on a 64-byte boundary
+    storage.assign(capacity + kAlignFloats, 0.0f);
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+    uintptr_t aligned = (address + kAlignment - 1) & ~static_cast<uintptr_t>(kAlignment - 1);
+    base = reinterpret_cast<float*>(aligned);
+
+    // Reserved up front so freeRange() never allocates: each live table can
+    // split at most one free range
+    freeList.reserve(kMaxTables + 1);
+    if (capacity > 0) freeList.push_back({0, capacity});
+}
+
+TableHandle WavetableArena::allocate(int size, SampleFormat format) {
+    if (size <= 0) return kNoTable;
+    collect();
+
+    int index = -1;
+    for (int i = 0; i < kMaxTables; ++i) {
+        if (slots[i].refs.load(std::memory_order_acquire) == -1) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) return kNoTable;
+
+    const size_t count = alignUp(Wavetable::storageFor(size, format));
+    size_t offset;
+    if (!reserve(count, offset)) return kNoTable;
+
+    Slot& slot = slots[index];
+    slot.offset = offset;
+    slot.count = count;
+    slot.table = Wavetable(base + offset, size, format);
+    std::fill(base + offset, base + offset + count, 0.0f);
+    slot.refs.store(1, std::memory_order_release);
+    return (slot.generation.load(std::memory_order_relaxed) << 16) | static_cast<uint32_t>(index);
+}
+
+float* WavetableArena::samples(TableHandle handle) {
+    Slot* slot = slotFor(handle);
+    return slot ? slot->table.samples() : nullptr;
+}
+
+void WavetableArena::finalize(TableHandle handle) {
+    if (Slot* slot = slotFor(handle)) slot->table.finalize();
+}
+
+void WavetableArena::finalize(TableHandle handle, const float* source) {
+    if (Slot* slot = slotFor(handle)) slot->table.finalize(source);
+}
+
+bool WavetableArena::acquire(TableHandle handle) {
+    const uint32_t index = slotIndex(handle);
+    if (handle == kNoTable || index >= kMaxTables) return false;
+    Slot& slot = slots[index];
+
+    // Never revive a table whose last reference is gone: collect() may
+    // already be reclaiming it
+    int refs = slot.refs.load(std::memory_order_relaxed);
+    do {
+        if (refs <= 0) return false;
+    } while (!slot.refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire));
+
+    if (slot.generation.load(std::memory_order_acquire) != slotGeneration(handle)) {
+        slot.refs.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    return true;
+}
+
+void WavetableArena::release(TableHandle handle) {
+    const uint32_t index = slotIndex(handle);
+    if (handle == kNoTable || index >= kMaxTables) return;
+    slots[index].refs.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+int WavetableArena::references(TableHandle handle) const {
+    Slot* slot = slotFor(handle);
+    return slot ? slot->refs.load(std::memory_order_acquire) : 0;
+}
+
+const Wavetable* WavetableArena::get(TableHandle handle) const {
+    Slot* slot = slotFor(handle);
+    return slot ? &slot->table : nullptr;
+}
+
+int WavetableArena::tableCount() const {
+    int count = 0;
+    for (int i = 0; i < kMaxTables; ++i) {
+        if (slots[i].refs.load(std::memory_order_relaxed) > 0) count++;
+    }
+    return count;
+}
+
+WavetableArena::Slot* WavetableArena::slotFor(TableHandle handle) const {
+    const uint32_t index = slotIndex(handle);
+    if (handle == kNoTable || index >= kMaxTables) return nullptr;
+    Slot& slot = slots[index];
+    if (slot.refs.load(std::memory_order_acquire) <= 0 ||
+        slot.generation.load(std::memory_order_acquire) != slotGeneration(handle)) {
+        return nullptr;
+    }
+    return &slot;
+}
+
+void WavetableArena::collect() {
+    for (int i = 0; i < kMaxTables; ++i) {
+        Slot& slot = slots[i];
+        int expected = 0;
+        if (!slot.refs.compare_exchange_strong(expected, -1, std::memory_order_acq_rel)) continue;
+
+        // Generation 0 is skipped so no handle ever equals kNoTable
+        uint32_t generation = (slot.generation.load(std::memory_order_relaxed) + 1) & 0xffffu;
+        slot.generation.store(generation ? generation : 1, std::memory_order_release);
+        freeRange(slot.offset, slot.count);
+        slot.table = Wavetable();
+    }
+}
+
+bool WavetableArena::reserve(size_t count, size_t& offset) {
+    // First fit keeps long-lived tables packed at the front
+    for (size_t i = 0; i < freeList.size(); ++i) {
+        Range& range = freeList[i];
+        if (range.count < count) continue;
+        offset = range.offset;
+        range.offset += count;
+        range.count -= count;
+        if (range.count == 0) freeList.erase(freeList.begin() + i);
+        used += count;
+        return true;
+    }
+    return false;
+}
+
+void WavetableArena::freeRange(size_t offset, size_t count) {
+    used -= count;
+    auto next = std::lower_bound(freeList.begin(), freeList.end(), offset,
+                                 [](const Range& r, size_t o) { return r.offset < o; });
+
+    // Merge with the neighbours on either side
+    bool joinPrev = next != freeList.begin() && std::prev(next)->offset + std::prev(next)->count == offset;
+    bool joinNext = next != freeList.end() && offset + count == next->offset;
+    if (joinPrev && joinNext) {
+        std::prev(next)->count += count + next->count;
+        freeList.erase(next);
+    } else if (joinPrev) {
+        std::prev(next)->count += count;
+    } else if (joinNext) {
+        next->offset = offset;
+        next->count += count;
+    } else {
+        freeList.insert(next, {offset, count});
+    }
+}
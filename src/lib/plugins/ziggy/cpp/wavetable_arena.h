@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "wavetable.h"
+
+// Handle to a table in a WavetableArena: bits 16-31 hold the slot's
+// generation, bits 0-15 its index. 0 is never a valid handle.
+using TableHandle = uint32_t;
+constexpr TableHandle kNoTable = 0;
+
+// Every wavetable (and its mip levels) lives in one contiguous, 64-byte
+// aligned block of fixed capacity, so memory use is bounded up front and voices
+// sharing a table share cache lines.
+//
+// Tables are reference counted. allocate() hands back a handle owning one
+// reference; voices take their own with acquire() and drop it with release().
+// Storage of tables nobody references is reclaimed by the next allocate(), and
+// reclaiming bumps the slot's generation, so a stale handle resolves to nullptr
+// instead of someone else's samples.
+//
+// allocate()/finalize() belong to the control side, one thread at a time
+// (WavetableLoader serializes them). acquire(), release() and get() only touch
+// atomics and may be called from the render path.
+class WavetableArena {
+public:
+    static constexpr int kMaxTables = 256;
+    static constexpr size_t kAlignment = 64;
+
+    explicit WavetableArena(size_t capacityBytes);
+
+    WavetableArena(const WavetableArena&) = delete;
+    WavetableArena& operator=(const WavetableArena&) = delete;
+
+    // Reserves a table of size samples. Returns kNoTable when the arena or the
+    // slot table is full. Write level 0 of a float table through samples(),
+    // then finalize(); or build any table with finalize(handle, source).
+    TableHandle allocate(int size, SampleFormat format = SampleFormat::Float32);
+    float* samples(TableHandle handle);
+    void finalize(TableHandle handle);
+    void finalize(TableHandle handle, const float* source);
+
+    // Adds a reference; fails for stale handles and tables already released
+    bool acquire(TableHandle handle);
+    void release(TableHandle handle);
+    // References held on a table; 0 for stale handles
+    int references(TableHandle handle) const;
+
+    // nullptr for stale or unknown handles
+    const Wavetable* get(TableHandle handle) const;
+
+    size_t capacityBytes() const { return capacity * sizeof(float); }
+    size_t bytesUsed() const { return used * sizeof(float); }
+    int tableCount() const;
+
+private:
+    struct Slot {
+        Wavetable table;
+        size_t offset = 0;
+        size_t count = 0;
+        // > 0: live, 0: released and awaiting reclaim, -1: free
+        std::atomic<int> refs{-1};
+        std::atomic<uint32_t> generation{1};
+    };
+
+    struct Range {
+        size_t offset;
+        size_t count;
+    };
+
+    Slot* slotFor(TableHandle handle) const;
+    // Returns storage of unreferenced tables to the free list
+    void collect();
+    bool reserve(size_t count, size_t& offset);
+    void freeRange(size_t offset, size_t count);
+
+    std::vector<float> storage;
+    float* base = nullptr;
+    size_t capacity = 0;  // in floats
+    size_t used = 0;
+    std::unique_ptr<Slot[]> slots;
+    // Free ranges sorted by offset and coalesced
+    std::vector<Range> freeList;
+};
@@ -0,0 +1,390 @@
+#include "wavetable_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "audio_decoder.h"
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define ZIGGY_NO_THREADS 1
+#endif
+
+namespace {
+
+// Samples a decoded file becomes as a table
+int fittedSize(size_t length) {
+    if (length >= static_cast<size_t>(WavetableLoader::kOneShotSize)) return static_cast<int>(length);
+    int cycles = std::max(1, static_cast<int>(std::lround(static_cast<double>(length) / WavetableLoader::kCycleSize)));
+    return WavetableLoader::kCycleSize * cycles;
+}
+
+// Linear resample of a looped cycle to size samples
+void fit(const std::vector<float>& source, float* out, int size) {
+    const size_t length = source.size();
+    if (static_cast<size_t>(size) == length) {
+        std::copy(source.begin(), source.end(), out);
+        return;
+    }
+    const double step = static_cast<double>(length) / size;
+    for (int i = 0; i < size; ++i) {
+        double position = i * step;
+        size_t index = static_cast<size_t>(position) % length;
+        size_t next = (index + 1) % length;
+        float fraction = static_cast<float>(position - std::floor(position));
+        out[i] = (1.0f - fraction) * source[index] + fraction * source[next];
+    }
+}
+
+// Arena bytes a table takes, as counted against the budget
+size_t tableBytes(int size, SampleFormat format) {
+    return Wavetable::storageFor(size, format) * sizeof(float);
+}
+
+}
+
+WavetableLoader::WavetableLoader(WavetableArena& arena)
+    : arena(arena), entries(new Entry[kMaxKeys]), budget(arena.capacityBytes()) {}
+
+WavetableLoader::~WavetableLoader() {
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        quit = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+TableHandle WavetableLoader::allocate(int size, SampleFormat format) {
+    std::lock_guard<std::mutex> lock(control);
+    return arena.allocate(size, format);
+}
+
+bool WavetableLoader::publish(float key, TableHandle handle, const float* source) {
+    if (handle == kNoTable) return false;
+    // The table is the caller's alone until it is published
+    if (source) arena.finalize(handle, source);
+    else arena.finalize(handle);
+
+    std::lock_guard<std::mutex> lock(control);
+    Entry* entry = entryFor(key);
+    if (!entry) entry = createEntry(key);
+    if (!entry) {
+        arena.release(handle);
+        return false;
+    }
+
+    // Tables given as samples have nothing to reload from, so they stay
+    entry->loadable.store(false, std::memory_order_relaxed);
+    if (entry->encoded) {
+        encodedBytes -= entry->encoded->size();
+        entry->encoded.reset();
+    }
+    replace(*entry, handle);
+    return true;
+}
+
+bool WavetableLoader::load(float key, std::vector<uint8_t> encoded, SampleFormat format) {
+    std::lock_guard<std::mutex> lock(control);
+    Entry* entry = entryFor(key);
+    if (!entry) entry = createEntry(key);
+    if (!entry) {
+        failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (entry->encoded) encodedBytes -= entry->encoded->size();
+    encodedBytes += encoded.size();
+    entry->encoded = std::make_shared<const std::vector<uint8_t>>(std::move(encoded));
+    entry->format = format;
+    entry->loadable.store(true, std::memory_order_release);
+
+    // A key that is playing swaps to the new file as soon as it is ready
+    if (entry->handle.load(std::memory_order_relaxed) != kNoTable) {
+        if (entry->queued) entry->again = true;
+        else queueLoad(*entry);
+    }
+#ifndef ZIGGY_NO_THREADS
+    // Started with the first file, so engines that never load one never own
+    // a thread; from then on it also watches for requests
+    std::lock_guard<std::mutex> queue(queueLock);
+    if (!worker.joinable()) worker = std::thread([this] { workerLoop(); });
+    requests.fetch_add(1, std::memory_order_release);
+    wake.notify_one();
+#endif
+    return true;
+}
+
+void WavetableLoader::preload(float key) {
+    std::lock_guard<std::mutex> lock(control);
+    Entry* entry = entryFor(key);
+    if (entry && entry->encoded && !entry->queued && entry->handle.load(std::memory_order_relaxed) == kNoTable) {
+        queueLoad(*entry);
+    }
+}
+
+void WavetableLoader::wait() {
+#ifdef ZIGGY_NO_THREADS
+    std::vector<float> decoded;
+    while (runNext(decoded)) {}
+#else
+    std::unique_lock<std::mutex> lock(queueLock);
+    drained.wait(lock, [this] { return queued.load(std::memory_order_acquire) == 0; });
+#endif
+}
+
+void WavetableLoader::service() {
+#ifdef ZIGGY_NO_THREADS
+    // One file per call keeps a render quantum from stalling on several
+    collectRequests();
+    std::vector<float> decoded;
+    runNext(decoded);
+#endif
+}
+
+void WavetableLoader::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(control);
+    budget = std::min(bytes, arena.capacityBytes());
+    if (makeRoom(0, false)) {
+        // Evicted keys are for the worker to watch
+        std::lock_guard<std::mutex> queue(queueLock);
+        requests.fetch_add(1, std::memory_order_release);
+        wake.notify_one();
+    }
+}
+
+WavetableStats WavetableLoader::stats() const {
+    std::lock_guard<std::mutex> lock(control);
+    WavetableStats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.loads = loads;
+    stats.evictions = evictions;
+    stats.failures = failed.load(std::memory_order_relaxed);
+    stats.bytes = cachedBytes;
+    stats.budget = budget;
+    stats.encodedBytes = encodedBytes;
+    const int n = count.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; ++i) {
+        if (entries[i].handle.load(std::memory_order_relaxed) != kNoTable) stats.tables++;
+    }
+    return stats;
+}
+
+TableHandle WavetableLoader::find(float key) const {
+    const int n = count.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        if (entries[i].key == key) return entries[i].handle.load(std::memory_order_acquire);
+    }
+    return kNoTable;
+}
+
+bool WavetableLoader::awaiting(float key) const {
+    const int n = count.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        const Entry& entry = entries[i];
+        if (entry.key != key) continue;
+        return entry.loadable.load(std::memory_order_acquire) && entry.handle.load(std::memory_order_acquire) == kNoTable;
+    }
+    return false;
+}
+
+TableHandle WavetableLoader::acquire(float key, bool countUse) {
+    const int n = count.load(std::memory_order_acquire);
+    Entry* entry = std::find_if(entries.get(), entries.get() + n, [key](const Entry& e) { return e.key == key; });
+    if (entry == entries.get() + n) return kNoTable;
+
+    TableHandle handle = entry->handle.load(std::memory_order_acquire);
+    // The key always holds its table, so acquire only fails when a new one
+    // was published or the table evicted in between
+    while (handle != kNoTable && !arena.acquire(handle)) {
+        TableHandle again = entry->handle.load(std::memory_order_acquire);
+        if (again == handle) {
+            handle = kNoTable;
+            break;
+        }
+        handle = again;
+    }
+    if (!countUse) return handle;
+
+    if (handle != kNoTable) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        entry->lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    } else if (entry->loadable.load(std::memory_order_acquire)) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        // The worker polls for requests: waking it would mean a syscall here
+        if (!entry->wanted.exchange(true, std::memory_order_acq_rel)) {
+            requests.fetch_add(1, std::memory_order_release);
+        }
+    }
+    return handle;
+}
+
+WavetableLoader::Entry* WavetableLoader::entryFor(float key) {
+    const int n = count.load(std::memory_order_relaxed);
+    Entry* entry = std::find_if(entries.get(), entries.get() + n, [key](const Entry& e) { return e.key == key; });
+    return entry == entries.get() + n ? nullptr : entry;
+}
+
+WavetableLoader::Entry* WavetableLoader::createEntry(float key) {
+    const int n = count.load(std::memory_order_relaxed);
+    if (n == kMaxKeys) return nullptr;
+    entries[n].key = key;
+    count.store(n + 1, std::memory_order_release);
+    return &entries[n];
+}
+
+void WavetableLoader::queueLoad(Entry& entry) {
+    entry.queued = true;
+    std::lock_guard<std::mutex> lock(queueLock);
+    jobs.push_back(entry.key);
+    queued.fetch_add(1, std::memory_order_release);
+    wake.notify_one();
+}
+
+bool WavetableLoader::collectRequests() {
+    std::lock_guard<std::mutex> lock(control);
+    bool unloaded = false;
+    const int n = count.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; ++i) {
+        Entry& entry = entries[i];
+        if (!entry.encoded || entry.queued || entry.handle.load(std::memory_order_relaxed) != kNoTable) continue;
+        if (entry.wanted.exchange(false, std::memory_order_acq_rel)) queueLoad(entry);
+        else unloaded |= entry.loadable.load(std::memory_order_relaxed);
+    }
+    return unloaded;
+}
+
+bool WavetableLoader::makeRoom(size_t needed, bool force) {
+    bool evicted = false;
+    while (force ? !evicted : cachedBytes + needed > budget) {
+        const int n = count.load(std::memory_order_relaxed);
+        Entry* victim = nullptr;
+        for (int i = 0; i < n; ++i) {
+            Entry& entry = entries[i];
+            TableHandle handle = entry.handle.load(std::memory_order_relaxed);
+            // Only the key's own reference: no voice is playing it
+            if (!entry.encoded || handle == kNoTable || arena.references(handle) != 1) continue;
+            if (!victim || entry.lastUse.load(std::memory_order_relaxed) < victim->lastUse.load(std::memory_order_relaxed)) {
+                victim = &entry;
+            }
+        }
+        if (!victim) break;
+        // A voice taking the table meanwhile keeps it alive until it lets go
+        unpublish(*victim);
+        evictions++;
+        evicted = true;
+    }
+    return evicted;
+}
+
+void WavetableLoader::unpublish(Entry& entry) {
+    cachedBytes -= entry.bytes;
+    entry.bytes = 0;
+    arena.release(entry.handle.exchange(kNoTable, std::memory_order_acq_rel));
+}
+
+void WavetableLoader::replace(Entry& entry, TableHandle handle) {
+    cachedBytes -= entry.bytes;
+    entry.bytes = 0;
+    if (entry.encoded) {
+        const Wavetable* table = arena.get(handle);
+        entry.bytes = tableBytes(table->size(), table->sampleFormat());
+        cachedBytes += entry.bytes;
+    }
+    entry.lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // The key's reference moves to the new table; the old one lives on
+    // until the last voice using it lets go
+    arena.release(entry.handle.exchange(handle, std::memory_order_acq_rel));
+}
+
+void WavetableLoader::prepare(float key, std::vector<float>& decoded) {
+    std::shared_ptr<const std::vector<uint8_t>> encoded;
+    SampleFormat format;
+    {
+        std::lock_guard<std::mutex> lock(control);
+        Entry* entry = entryFor(key);
+        encoded = entry->encoded;
+        format = entry->format;
+    }
+
+    TableHandle handle = kNoTable;
+    int size = 0;
+    const bool decodes = encoded && decodeAudio(encoded->data(), encoded->size(), decoded);
+    if (decodes) {
+        size = fittedSize(decoded.size());
+        std::lock_guard<std::mutex> lock(control);
+        makeRoom(tableBytes(size, format), false);
+        handle = arena.allocate(size, format);
+        // Over the budget the arena may still be too full or fragmented
+        while (handle == kNoTable && makeRoom(0, true)) handle = arena.allocate(size, format);
+    }
+
+    // The table is ours alone until it is published
+    if (handle != kNoTable && format == SampleFormat::Float32) {
+        fit(decoded, arena.samples(handle), size);
+        arena.finalize(handle);
+    } else if (handle != kNoTable) {
+        // Compact tables are built from float samples
+        std::vector<float> fitted(size);
+        fit(decoded, fitted.data(), size);
+        arena.finalize(handle, fitted.data());
+    }
+
+    std::lock_guard<std::mutex> lock(control);
+    Entry& entry = *entryFor(key);
+    entry.queued = false;
+    // Published as samples meanwhile, or registered again
+    const bool current = entry.encoded == encoded;
+    if (handle != kNoTable && current) {
+        replace(entry, handle);
+        loads++;
+    } else {
+        arena.release(handle);
+        if (current) failed.fetch_add(1, std::memory_order_relaxed);
+        // A file that doesn't decode isn't requested again until replaced
+        if (current && !decodes) entry.loadable.store(false, std::memory_order_relaxed);
+    }
+    if (entry.again || (!current && entry.encoded)) {
+        entry.again = false;
+        queueLoad(entry);
+    }
+}
+
+bool WavetableLoader::runNext(std::vector<float>& decoded) {
+    float key;
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        if (jobs.empty()) return false;
+        key = jobs.front();
+        jobs.pop_front();
+    }
+    prepare(key, decoded);
+
+    std::lock_guard<std::mutex> lock(queueLock);
+    queued.fetch_sub(1, std::memory_order_acq_rel);
+    drained.notify_all();
+    return true;
+}
+
+void WavetableLoader::workerLoop() {
+    // Reused across jobs
+    std::vector<float> decoded;
+    int poll = kPollMilliseconds;
+    for (;;) {
+        const uint32_t seen = requests.load(std::memory_order_acquire);
+        collectRequests();
+        while (runNext(decoded)) {}
+        // Polls for requests only while some file waits for its next use.
+        // Checked after the loads, which may have evicted other keys.
+        const bool watching = collectRequests();
+
+        std::unique_lock<std::mutex> lock(queueLock);
+        auto ready = [&] { return quit || !jobs.empty() || requests.load(std::memory_order_acquire) != seen; };
+        bool requested = true;
+        if (watching) requested = wake.wait_for(lock, std::chrono::milliseconds(poll), ready);
+        else wake.wait(lock, ready);
+        if (quit) return;
+        // Backs off while nothing is requested, so idle files don't keep the
+        // worker waking every few milliseconds
+        poll = requested ? kPollMilliseconds : std::min(poll * 2, kIdlePollMilliseconds);
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "wavetable_arena.h"
+
+// Table cache counters. hits and misses count note-on lookups of keys with
+// something registered; bytes is what decoded tables take in the arena, the
+// figure the budget bounds.
+struct WavetableStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;       // not loaded yet: played silent, load requested
+    uint64_t loads = 0;        // files decoded and published
+    uint64_t evictions = 0;
+    uint64_t failures = 0;     // files that could not be decoded or did not fit
+    size_t bytes = 0;
+    size_t budget = 0;
+    size_t encodedBytes = 0;   // compressed files kept for reloading
+    int tables = 0;            // keys with a table published
+};
+
+// The control side of a WavetableArena: which table each key plays, and a
+// cache of tables decoded from encoded audio files on a background worker.
+//
+// A key's table is published with an atomic swap. The key holds one
+// reference on its table; voices resolve the key and take their own with
+// acquire(), so a replaced table lives on until its last voice lets go.
+// acquire() only touches atomics and may be called from the render path.
+// Everything else may run on any control thread and is serialized here; none
+// of it is ever waited on by the render path.
+//
+// Encoded files are registered with load() and decoded lazily: the first
+// acquire() of a key whose table isn't loaded misses, and the worker picks up
+// the request within kPollMilliseconds, or kIdlePollMilliseconds when nothing
+// has been requested for a while (the interval doubles with every poll that
+// finds no request). It decodes the file (audio_decoder.h), fits it to a
+// wavetable, writes it straight into the arena, builds the mip levels and
+// publishes the result, all off the audio thread. Decoded tables
+// stay within a byte budget: the least recently played tables are evicted
+// first, back to their encoded bytes, and a table any voice holds is never
+// evicted. When every table is in use a load goes ahead over the budget.
+// Tables loaded from samples (allocate/publish) can't be reloaded and are
+// never evicted.
+//
+// Builds without thread support (plain emcc) have no worker; requests are
+// served by service(), which the host calls between render calls.
+class WavetableLoader {
+public:
+    static constexpr int kMaxKeys = WavetableArena::kMaxTables;
+    // Short decoded files are resampled to a whole number of cycles of this
+    // length, as the JS loader did; kOneShotSize samples or more are kept as
+    // they are
+    static constexpr int kCycleSize = 1348;
+    static constexpr int kOneShotSize = 10000;
+    static constexpr int kPollMilliseconds = 2;
+    static constexpr int kIdlePollMilliseconds = 32;
+
+    explicit WavetableLoader(WavetableArena& arena);
+    ~WavetableLoader();
+
+    WavetableLoader(const WavetableLoader&) = delete;
+    WavetableLoader& operator=(const WavetableLoader&) = delete;
+
+    // Reserves a table in the arena; kNoTable when it is full
+    TableHandle allocate(int size, SampleFormat format = SampleFormat::Float32);
+    // Builds the mip levels of an allocated table, from source if given (as
+    // WavetableArena::finalize), and publishes it under key, taking over the
+    // handle's reference. The table stays until replaced. Fails when every
+    // key is taken, dropping the table.
+    bool publish(float key, TableHandle handle, const float* source = nullptr);
+
+    // Registers an encoded file (Ogg/Vorbis or WAV) for key, stored in
+    // format once decoded. A key with a table loaded is reloaded straight
+    // away and keeps its current table until the new one is ready; otherwise
+    // the file is decoded on the key's first use. Fails when every key is
+    // taken.
+    bool load(float key, std::vector<uint8_t> encoded, SampleFormat format = SampleFormat::Float32);
+    // Decodes key's file now rather than on first use
+    void preload(float key);
+    // Blocks until every queued load has been published or has failed
+    void wait();
+    int pending() const { return queued.load(std::memory_order_acquire); }
+    int failures() const { return static_cast<int>(failed.load(std::memory_order_relaxed)); }
+    // Serves load requests in builds without a worker; does nothing in the
+    // others
+    void service();
+
+    // Bytes of decoded tables to keep, at most the arena's capacity (the
+    // default). Evicts idle tables down to it straight away.
+    void setBudget(size_t bytes);
+    WavetableStats stats() const;
+
+    // Takes a reference on key's table for the caller to release, or returns
+    // kNoTable if nothing is loaded, requesting the load. Counted as a hit or
+    // a miss, and as a use for the LRU, when countUse.
+    TableHandle acquire(float key, bool countUse = true);
+    // The table published under key, or kNoTable
+    TableHandle find(float key) const;
+    // Whether key has a file registered that isn't loaded yet
+    bool awaiting(float key) const;
+
+private:
+    struct Entry {
+        float key = 0.0f;
+        std::atomic<TableHandle> handle{kNoTable};
+        std::atomic<uint32_t> lastUse{0};
+        // A file is registered, and a voice wants it loaded
+        std::atomic<bool> loadable{false};
+        std::atomic<bool> wanted{false};
+        // Under control
+        std::shared_ptr<const std::vector<uint8_t>> encoded;
+        SampleFormat format = SampleFormat::Float32;
+        size_t bytes = 0;     // of the published table, when decoded
+        bool queued = false;  // a load is pending
+        bool again = false;   // a new file came while it was
+    };
+
+    // Under control
+    Entry* entryFor(float key);
+    // A new key; nullptr when every key is taken
+    Entry* createEntry(float key);
+    void queueLoad(Entry& entry);
+    // Queues the loads voices asked for; whether other files wait unloaded
+    bool collectRequests();
+    // Evicts idle decoded tables, least recently used first, until needed
+    // more bytes fit the budget; with force, at least one. Whether any was.
+    bool makeRoom(size_t needed, bool force);
+    void unpublish(Entry& entry);
+    // Swaps in key's table, handing the key's reference on the old one back
+    void replace(Entry& entry, TableHandle handle);
+
+    // Decodes and publishes one key's file
+    void prepare(float key, std::vector<float>& decoded);
+    // Runs the oldest queued load; false if there was none
+    bool runNext(std::vector<float>& decoded);
+    void workerLoop();
+
+    WavetableArena& arena;
+    // Serializes arena allocation, publishing and the entries' control side
+    mutable std::mutex control;
+
+    // Keys are appended, never removed: an entry is complete before count
+    // covers it
+    std::unique_ptr<Entry[]> entries;
+    std::atomic<int> count{0};
+    size_t budget;
+    size_t cachedBytes = 0;
+    size_t encodedBytes = 0;
+
+    std::atomic<uint32_t> useClock{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint32_t> requests{0};  // bumped when entries need the worker
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    std::atomic<uint64_t> failed{0};
+
+    std::mutex queueLock;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::deque<float> jobs;
+    std::atomic<int> queued{0};
+    bool quit = false;
+    std::thread worker;
+};
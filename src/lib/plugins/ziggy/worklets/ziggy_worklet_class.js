@@ -1,60 +1,194 @@
+// EngineEvent::Type in event_queue.h
+const EVENT_NOTE_ON = 1;
+const EVENT_NOTE_OFF = 2;
+const EVENT_SET_PARAM = 3;
+
+// SampleFormat in oscillator.h
+const SAMPLE_FORMATS = { float: 0, int16: 1, half: 2 };
+
+// WavetableLoader::kMaxKeys: engine keys are never freed, so URLs share a
+// bounded set of slots
+const MAX_WAVETABLE_SLOTS = 256;
+
+// Largest render quantum we expect from the host. Web Audio renders 128
+// frames today; the engine works through bigger blocks in sub-blocks.
+const MAX_BLOCK_SIZE = 1024;
+
 class ZiggyProcessor extends AudioWorkletProcessor {
     constructor() {
         super();
 
         const mod = new Module();
-        this.synth = new mod.PolySynth(44100, 16);
+        // sampleRate is the AudioWorkletGlobalScope's, i.e. the context's actual rate
+        this.synth = new mod.PolySynth(sampleRate, 16, MAX_BLOCK_SIZE);
         this.mod = mod;  // Store the module instance
         
-        // Pre-allocate the buffer memory once, using standard audio buffer size of 128
-        this.outputPtr = this.mod._malloc(128 * 4 * 2);
-        this.outputHeap = new Float32Array(this.mod.HEAPF32.buffer, this.outputPtr, 128 * 2);
+        // Pre-allocate planar stereo output for the largest block once: the
+        // left channel, then the right
+        this.maxBlockSize = this.synth.maxBlockSize();
+        this.outputPtr = this.mod._malloc(this.maxBlockSize * 4 * 2);
+        this.rightPtr = this.outputPtr + this.maxBlockSize * 4;
         
-        // Keep track of wavetable URL to slot mappings
+        // Keep track of wavetable URL to slot mappings, least recently used
+        // first, and the URLs the oscillators are set to
         this.wavetableSlots = new Map();
         this.nextSlot = 0;
+        this.waves = {};
+        this.currentWaves = new Set();
+
+        // Notes and parameters are written straight into the engine's event
+        // queue in the WASM heap, timestamped so they land on their exact
+        // sample inside a block. The queue takes events in frame order, so
+        // they wait in scheduled, sorted, until the block they fall in; the
+        // writer is this port handler, on the audio thread like the reader.
+        this.scheduled = [];
+        this.eventBufferPtr = this.synth.eventBufferPtr();
+        this.eventWritePtr = this.synth.eventWriteIndexPtr();
+        this.eventReadPtr = this.synth.eventReadIndexPtr();
+        this.eventCapacity = this.synth.eventCapacity();
+        this.paramIds = new Map();
+        this.startFrame = undefined;
 
         this.port.onmessage = (e) => {
             if (e.data.type === 'noteon') {
-                this.synth.noteOn(e.data.key, e.data.v);
+                this.schedule(EVENT_NOTE_ON, this.frameFor(e.data.time), e.data.key, e.data.v);
             }
             else if (e.data.type === 'noteoff') {
-                this.synth.noteOff(e.data.key);
+                this.schedule(EVENT_NOTE_OFF, this.frameFor(e.data.time), e.data.key, 0);
             }
             else if (e.data.type === 'properties') {
                 // Replace wavetable URLs with their corresponding slot numbers
                 const {wave1, wave2, wave3, ...properties} = e.data.properties
                 
                 if(wave1) 
-                    properties.wave1 = this.wavetableSlots.get(wave1)
+                    properties.wave1 = this.useWave('wave1', wave1)
                 if(wave2)
-                    properties.wave2 = this.wavetableSlots.get(wave2)
+                    properties.wave2 = this.useWave('wave2', wave2)
                 if(wave3)
-                    properties.wave3 = this.wavetableSlots.get(wave3)
+                    properties.wave3 = this.useWave('wave3', wave3)
 
 
                 console.log("properties", properties)
-                this.synth.setProperties(properties);
+                const frame = this.frameFor(e.data.time);
+                for (const name in properties) {
+                    const id = this.paramId(name);
+                    if (id >= 0) this.schedule(EVENT_SET_PARAM, frame, id, properties[name]);
+                }
             }
             else if (e.data.type === 'debug') {
                 this.debug = e.data.debug;
             }
+            else if (e.data.type === 'loadencodedwavetable') {
+                // The engine keeps the file and decodes it in the background
+                // when a note first needs it, so a URL it has is not sent
+                // again
+                if (this.wavetableSlots.has(e.data.key)) {
+                    this.wavetableSlot(e.data.key);
+                    return;
+                }
+                const slot = this.wavetableSlot(e.data.key);
+                const format = SAMPLE_FORMATS[e.data.format] ?? SAMPLE_FORMATS.float;
+                this.synth.loadEncodedWavetable(slot, new Uint8Array(e.data.bytes), format);
+            }
             else if (e.data.type === 'loadwavetable') {
                 const key = e.data.key;
-                let slot = this.wavetableSlots.get(key);
-                
-                if (slot === undefined) {
-                    slot = this.nextSlot++;
-                    this.wavetableSlots.set(key, slot);
-                }
+                const slot = this.wavetableSlot(key);
 
                 console.log("loadwavetable", key, this.wavetableSlots)
                 
-                this.synth.loadWavetable(slot, new Float32Array(e.data.table));
+                // Write the samples straight into engine memory: one bulk
+                // copy, no per-sample JS<->WASM calls
+                const table = new Float32Array(e.data.table);
+                const ptr = this.synth.beginWavetable(table.length);
+                if (ptr) {
+                    this.mod.HEAPF32.set(table, ptr >> 2);
+                    this.synth.commitWavetable(slot);
+                }
             }
         };
     }
     
+    // Engine key for a wavetable URL, assigned on first use. Once every
+    // slot is taken, the least recently used URL no oscillator is set to
+    // gives up its slot.
+    wavetableSlot(key) {
+        let slot = this.wavetableSlots.get(key);
+        if (slot !== undefined) {
+            // Map order is the LRU order
+            this.wavetableSlots.delete(key);
+        } else if (this.nextSlot < MAX_WAVETABLE_SLOTS) {
+            slot = this.nextSlot++;
+        } else {
+            for (const [url, used] of this.wavetableSlots) {
+                if (this.currentWaves.has(url)) continue;
+                this.wavetableSlots.delete(url);
+                slot = used;
+                break;
+            }
+        }
+        this.wavetableSlots.set(key, slot);
+        return slot;
+    }
+
+    // Slot for an oscillator's wave URL, which keeps it until replaced
+    useWave(name, url) {
+        this.waves[name] = url;
+        this.currentWaves = new Set(Object.values(this.waves));
+        return this.wavetableSlots.has(url) ? this.wavetableSlot(url) : undefined;
+    }
+
+    // Engine frame for an AudioContext time; undefined means as soon as possible
+    frameFor(time) {
+        if (this.startFrame === undefined) return 0;
+        if (time === undefined) return currentFrame - this.startFrame;
+        return Math.round(time * sampleRate) - this.startFrame;
+    }
+
+    paramId(name) {
+        let id = this.paramIds.get(name);
+        if (id === undefined) {
+            id = this.mod.paramId(name);
+            this.paramIds.set(name, id);
+        }
+        return id;
+    }
+
+    // Queues an event behind every other one for the same frame or earlier
+    schedule(type, frame, data, value) {
+        let at = this.scheduled.length;
+        while (at > 0 && this.scheduled[at - 1].frame > frame) at--;
+        this.scheduled.splice(at, 0, { type, frame, data, value });
+    }
+
+    // Moves the events that fall before end into the engine's queue. Those
+    // that don't fit while it's full stay for the next block and apply late.
+    flushEvents(end) {
+        let sent = 0;
+        while (sent < this.scheduled.length && this.scheduled[sent].frame < end) {
+            const { type, frame, data, value } = this.scheduled[sent];
+            if (!this.pushEvent(type, frame, data, value)) break;
+            sent++;
+        }
+        if (sent > 0) this.scheduled.splice(0, sent);
+    }
+
+    // Appends one 16-byte event to the SPSC ring. Returns false when full.
+    pushEvent(type, frame, data, value) {
+        // Re-read the heap views every time, memory growth replaces them
+        const u32 = this.mod.HEAPU32;
+        const write = Atomics.load(u32, this.eventWritePtr >> 2);
+        const read = Atomics.load(u32, this.eventReadPtr >> 2);
+        if (((write - read) >>> 0) >= this.eventCapacity) return false;
+
+        const slot = (this.eventBufferPtr >> 2) + (write & (this.eventCapacity - 1)) * 4;
+        u32[slot] = type;
+        u32[slot + 1] = frame >>> 0;
+        this.mod.HEAP32[slot + 2] = data;
+        this.mod.HEAPF32[slot + 3] = value;
+        Atomics.store(u32, this.eventWritePtr >> 2, (write + 1) >>> 0);
+        return true;
+    }
+
     process(inputs, outputs) {
         const output = outputs[0];  // Get first output
         
@@ -66,25 +200,29 @@ class ZiggyProcessor extends AudioWorkletProcessor {
         
         const outputL = output[0];
         const outputR = output[1];
-      
+        const frames = Math.min(outputL.length, this.maxBlockSize);
 
-        if(this.debug) {
-            for (let i = 0; i < 128; i++) {
-                outputL[i] = this.outputHeap[i * 2];
-                outputR[i] = this.outputHeap[i * 2 + 1];
-            }
-        }
-        else {
+        // In debug mode the last rendered block is repeated
+        if(!this.debug) {
+            if (this.startFrame === undefined) this.startFrame = currentFrame;
+            // The engine consumes everything due before the block's end, so
+            // the queue never holds a later event for an earlier one to
+            // queue behind
+            this.flushEvents(currentFrame - this.startFrame + frames);
   
-            this.synth.processBuffer(this.outputPtr, 128);
-        
-            // Copy interleaved stereo data to separate channels
-            for (let i = 0; i < 128; i++) {
-                outputL[i] = this.outputHeap[i * 2];
-                outputR[i] = this.outputHeap[i * 2 + 1];
-            }
+            this.synth.processPlanar(this.outputPtr, this.rightPtr, frames);
+            // Without threads the engine decodes requested wavetables here
+            this.synth.serviceWavetables();
         }
 
+        // Copy each channel out in bulk. Re-read the heap view every time,
+        // memory growth replaces it
+        const heap = this.mod.HEAPF32;
+        const left = this.outputPtr >> 2;
+        const right = this.rightPtr >> 2;
+        outputL.set(heap.subarray(left, left + frames));
+        outputR.set(heap.subarray(right, right + frames));
+
         return true;
     }
     
@@ -92,7 +230,7 @@ class ZiggyProcessor extends AudioWorkletProcessor {
         if (this.outputPtr) {
             this.mod._free(this.outputPtr);
             this.outputPtr = null;
-            this.outputHeap = null;
+            this.rightPtr = null;
         }
     }
 }